@@ -1,9 +1,31 @@
+#pragma once
 
 #include <algorithm>
 #include <exception>
 #include <stdexcept>
 #include <utility>
 #include <type_traits>
+#include <typeinfo>
+
+#ifdef MEX_TRACE_EXPECTED
+#include "trace.h"
+  //Captures the site constructing an erroneous Expected (see trace.h). The
+  //defaults are evaluated at the call site, so functions creating erroneous
+  //Expecteds on behalf of their caller (fromException, fromCode) take the site
+  //too and pass it on via MEX_DETAIL_EXPECTED_SITE_ARGS.
+  #define MEX_DETAIL_EXPECTED_SITE_PARAM_LIST                               \
+    const char* siteFile = __builtin_FILE(), int siteLine = __builtin_LINE()
+  #define MEX_DETAIL_EXPECTED_SITE_DEFINITION_LIST const char* siteFile, int siteLine
+  #define MEX_DETAIL_EXPECTED_SITE_PARAMS , MEX_DETAIL_EXPECTED_SITE_PARAM_LIST
+  #define MEX_DETAIL_EXPECTED_SITE_DEFINITION , MEX_DETAIL_EXPECTED_SITE_DEFINITION_LIST
+  #define MEX_DETAIL_EXPECTED_SITE_ARGS , siteFile, siteLine
+#else
+  #define MEX_DETAIL_EXPECTED_SITE_PARAM_LIST
+  #define MEX_DETAIL_EXPECTED_SITE_DEFINITION_LIST
+  #define MEX_DETAIL_EXPECTED_SITE_PARAMS
+  #define MEX_DETAIL_EXPECTED_SITE_DEFINITION
+  #define MEX_DETAIL_EXPECTED_SITE_ARGS
+#endif
 
 /*
  *********************************OVERVIEW*************************************
@@ -35,6 +57,8 @@
  *        * Across thread boundaries
  *        * Across nothrow subsystem boundaries
  *        * Across time: save now, throw later
+ *        * Across process boundaries (for trivially copyable TYPEs, see
+ *          wire.h)
  *    * Collect, group, combine exceptions
  *
  * The key idea that allows this is that Expected<TYPE> is either a TYPE or the
@@ -146,9 +170,11 @@ public:
 
   template<typename EX,
   typename CHECK = typename std::enable_if<std::is_base_of<std::exception, EX>::value>::type>
-  Expected(const EX& ex); //Construct from class derived from std::exception.
+  Expected(const EX& ex MEX_DETAIL_EXPECTED_SITE_PARAMS);
+    //Construct from class derived from std::exception.
 
-  Expected(std::exception_ptr exptr); //Construct from std::exception_ptr
+  Expected(std::exception_ptr exptr MEX_DETAIL_EXPECTED_SITE_PARAMS);
+    //Construct from std::exception_ptr
 
   Expected(TYPE&& rhs); //Move construct from TYPE.
 
@@ -174,19 +200,25 @@ public:
   template<typename EX>
   bool hasException() const; //Allows you to query for the exception type.
 
-  static Expected<TYPE> fromException();
+  static Expected<TYPE> fromException(MEX_DETAIL_EXPECTED_SITE_PARAM_LIST);
     //If used within a catch statement, this will construct an Expected<TYPE>
     //that holds whatever exception is 'currently in flight' (whatever you just
     //caught).
 
   template<typename FUNC>
-  static Expected fromCode(FUNC func);
+  static Expected fromCode(FUNC func MEX_DETAIL_EXPECTED_SITE_PARAMS);
     //Syntactic sugar allowing you to wrap functions that use normal exception
     //handling code.
 
 
 
 private:
+  //Switch to holding the other alternative. becomeHam requires !gotHam and
+  //leaves *this untouched if constructing the TYPE throws.
+  template<typename ARG>
+  void becomeHam(ARG&& value);
+  void becomeSpam(std::exception_ptr exptr);
+
   union {
     TYPE ham;
     std::exception_ptr spam;
@@ -206,17 +238,28 @@ Expected<TYPE, ENABLE>::Expected(const TYPE& rhs) : ham(rhs), gotHam(true) {}
 
 template<typename TYPE, typename ENABLE>
 template<typename EX, typename CHECK>
-Expected<TYPE, ENABLE>::Expected(const EX& ex)
+Expected<TYPE, ENABLE>::Expected(const EX& ex MEX_DETAIL_EXPECTED_SITE_DEFINITION)
   : spam(std::make_exception_ptr(ex)), gotHam(false)
 {
   if(typeid(ex) != typeid(EX)) {
     throw std::invalid_argument("slicing detected");
   }
+#ifdef MEX_TRACE_EXPECTED
+  ::mex::trace::counterFor<EX>().increment();
+  ::mex::trace::detail::recordExpectedError(typeid(EX).name(), siteFile, siteLine);
+#endif
 }
 
 template<typename TYPE, typename ENABLE>
-Expected<TYPE, ENABLE>::Expected(std::exception_ptr exptr)
-  : spam(std::move(exptr)), gotHam(false) {}
+Expected<TYPE, ENABLE>::Expected(std::exception_ptr exptr
+                                 MEX_DETAIL_EXPECTED_SITE_DEFINITION)
+  : spam(std::move(exptr)), gotHam(false)
+{
+#ifdef MEX_TRACE_EXPECTED
+  //The dynamic type is only discoverable by rethrowing, which is too costly.
+  ::mex::trace::detail::recordExpectedError("std::exception_ptr", siteFile, siteLine);
+#endif
+}
 
 template<typename TYPE, typename ENABLE>
 Expected<TYPE, ENABLE>::Expected(TYPE&& rhs)
@@ -244,20 +287,57 @@ Expected<TYPE, ENABLE>::~Expected() {
 
 template<typename TYPE, typename ENABLE>
 Expected<TYPE>& Expected<TYPE, ENABLE>::operator=(const Expected<TYPE> &rhs) {
-  gotHam = rhs.gotHam;
-  if(gotHam) new(&ham) TYPE(rhs.ham);
-  else new(&spam) std::exception_ptr(rhs.spam);
+  if(this == &rhs) return *this;
+  if(gotHam && rhs.gotHam) {
+    ham = rhs.ham;
+  } else if(rhs.gotHam) {
+    becomeHam(rhs.ham);
+  } else {
+    becomeSpam(rhs.spam);
+  }
   return *this;
 }
 
 template<typename TYPE, typename ENABLE>
 Expected<TYPE>& Expected<TYPE, ENABLE>::operator=(Expected<TYPE> &&rhs) {
-  if(rhs.gotHam) ham = std::move(rhs.ham);
-  else spam = std::move(rhs.spam);
-  gotHam = rhs.gotHam;
+  if(this == &rhs) return *this;
+  if(gotHam && rhs.gotHam) {
+    ham = std::move(rhs.ham);
+  } else if(rhs.gotHam) {
+    becomeHam(std::move(rhs.ham));
+  } else {
+    becomeSpam(std::move(rhs.spam));
+  }
   return *this;
 }
 
+template<typename TYPE, typename ENABLE>
+template<typename ARG>
+void Expected<TYPE, ENABLE>::becomeHam(ARG&& value) {
+  //The TYPE must be built where the exception_ptr lives, so keep the
+  //exception aside until it has been.
+  std::exception_ptr saved = std::move(spam);
+  spam.~exception_ptr();
+  try {
+    new(&ham) TYPE(std::forward<ARG>(value));
+  } catch(...) {
+    new(&spam) std::exception_ptr(std::move(saved));
+    throw;
+  }
+  gotHam = true;
+}
+
+template<typename TYPE, typename ENABLE>
+void Expected<TYPE, ENABLE>::becomeSpam(std::exception_ptr exptr) {
+  if(gotHam) {
+    ham.~TYPE();
+    new(&spam) std::exception_ptr(std::move(exptr));
+    gotHam = false;
+  } else {
+    spam = std::move(exptr);
+  }
+}
+
 template<typename TYPE, typename ENABLE>
 void Expected<TYPE, ENABLE>::swap(Expected& rhs) {
   if(gotHam) {
@@ -282,8 +362,9 @@ void Expected<TYPE, ENABLE>::swap(Expected& rhs) {
 }
 
 template<typename TYPE, typename ENABLE>
-Expected<TYPE> Expected<TYPE, ENABLE>::fromException() {
-  return Expected<TYPE>(std::current_exception());
+Expected<TYPE> Expected<TYPE, ENABLE>::fromException(
+    MEX_DETAIL_EXPECTED_SITE_DEFINITION_LIST) {
+  return Expected<TYPE>(std::current_exception() MEX_DETAIL_EXPECTED_SITE_ARGS);
 }
 
 template<typename TYPE, typename ENABLE>
@@ -322,11 +403,12 @@ bool Expected<TYPE, ENABLE>::hasException() const {
 
 template<typename TYPE, typename ENABLE>
 template<typename FUNC>
-Expected<TYPE, ENABLE> Expected<TYPE, ENABLE>::fromCode(FUNC func) {
+Expected<TYPE, ENABLE> Expected<TYPE, ENABLE>::fromCode(FUNC func
+                                                 MEX_DETAIL_EXPECTED_SITE_DEFINITION) {
   try {
     return Expected(func());
   } catch(...) {
-    return fromException();
+    return Expected(std::current_exception() MEX_DETAIL_EXPECTED_SITE_ARGS);
   }
 }
 
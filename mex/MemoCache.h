@@ -0,0 +1,492 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Expected.h"
+#include "std_oversights.h"
+
+/*
+ *********************************OVERVIEW*************************************
+ * MemoCache<Key, Expected<V>> memoizes an expensive, fallible computation -
+ * config parsing, schema lookups and the like - for many threads at once:
+ *
+   mex::MemoCache<std::string, Expected<Schema>> schemas(1000);
+   Expected<Schema> s = schemas.get(name, [&]() { return loadSchema(name); });
+ *
+ * get() returns the cached Expected if there is one, and otherwise runs the
+ * function via Expected<V>::fromCode (so it may throw, or return a V or an
+ * Expected<V>) and caches what it returns.
+ *
+ * Design:
+ *    * Keys are spread over independent shards, each with its own lock, table
+ *      and statistics.
+ *    * Hits take no lock. Each shard is an open addressing table of pointers
+ *      to immutable nodes; a reader announces itself on one of the shard's
+ *      two reader counts, the one for the current epoch, probes, and copies
+ *      the value out. A writer retires the nodes it unlinks, starts a new
+ *      epoch, and frees them once the previous epoch's count drains to zero.
+ *      New readers only ever join the current count, so that happens as soon
+ *      as the reads already under way finish, however busy the shard is. A
+ *      reader racing with a writer may miss an entry that is being moved; it
+ *      then takes the locked path, which looks again before computing
+ *      anything.
+ *    * Each shard holds at most ceil(capacity / shards) entries. Past that,
+ *      the entry to evict is chosen CLOCK style: hits set a node's referenced
+ *      bit, and the eviction hand clears set bits and evicts the first entry
+ *      whose bit is already clear.
+ *    * Misses on the same key are coalesced: the first thread computes while
+ *      the others wait for its result (single-flight). The function therefore
+ *      must not call get() on the same cache with the same key.
+ *    * Valid results are cached for MemoCacheOptions::valueTtl (forever by
+ *      default) and errors for errorTtl (by default errors are not cached at
+ *      all, so the next get() retries). Expired entries count as misses.
+ *
+ * stats() reports hits, misses (computations started), coalesced waits,
+ * evictions and expirations, summed over the shards.
+ */
+
+namespace mex {
+
+struct MemoCacheOptions {
+  std::size_t shards = 16; //Rounded up to a power of two.
+  std::chrono::nanoseconds valueTtl = std::chrono::nanoseconds::max();
+  std::chrono::nanoseconds errorTtl = std::chrono::nanoseconds::zero();
+};
+
+struct MemoCacheStats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t coalesced = 0;
+  std::uint64_t evictions = 0;
+  std::uint64_t expirations = 0;
+};
+
+//Only Expected values are supported; see the specialization below.
+template<typename Key, typename VALUE,
+         typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class MemoCache;
+
+template<typename Key, typename V, typename Hash, typename Equal>
+class MemoCache<Key, Expected<V>, Hash, Equal> {
+public:
+  explicit MemoCache(std::size_t capacity,
+                     MemoCacheOptions options = MemoCacheOptions(),
+                     Hash hash = Hash(), Equal equal = Equal());
+  ~MemoCache();
+
+  MemoCache(const MemoCache&) = delete;
+  MemoCache& operator=(const MemoCache&) = delete;
+
+  template<typename FUNC>
+  Expected<V> get(const Key& key, FUNC compute);
+
+  //Copies the cached result into out and returns true, if there is one.
+  //Never computes and never waits.
+  bool peek(const Key& key, Expected<V>& out) const;
+
+  void erase(const Key& key);
+  void clear();
+
+  std::size_t size() const;
+  std::size_t capacity() const { return shardCapacity_ * shardCount_; }
+  MemoCacheStats stats() const;
+
+private:
+  static constexpr std::int64_t kNever = std::numeric_limits<std::int64_t>::max();
+
+  struct Node {
+    std::size_t hash;
+    Key key;
+    Expected<V> value;
+    std::int64_t expiresAt; //Nanoseconds on steady_clock, or kNever.
+    mutable std::atomic<bool> referenced;
+
+    Node(std::size_t h, const Key& k, Expected<V> v, std::int64_t expiry)
+      : hash(h), key(k), value(std::move(v)), expiresAt(expiry), referenced(false) {}
+  };
+
+  struct Flight {
+    std::condition_variable cv;
+    bool done = false;
+    std::unique_ptr<Expected<V>> result;
+    std::exception_ptr error; //Why result could not be handed over.
+  };
+
+  struct Shard {
+    //Touched by every reader of the shard, so they share a cache line and
+    //are kept off the lines the writers modify. (Padding rather than alignas,
+    //which operator new[] does not honour before C++17.)
+    char padBefore[hardware_destructive_interference_size];
+    mutable std::atomic<std::uint64_t> epoch;
+    mutable std::atomic<std::size_t> readers[2]; //Indexed by epoch parity.
+    mutable std::atomic<std::uint64_t> hits;
+    char padAfter[hardware_destructive_interference_size];
+
+    std::mutex mutex;
+    std::unique_ptr<std::atomic<Node*>[]> slots;
+    std::size_t size = 0;
+    std::size_t hand = 0; //CLOCK hand.
+    std::vector<Node*> retired;  //Unlinked during the current epoch.
+    std::vector<Node*> draining; //Unlinked during the previous one.
+    std::unordered_map<Key, std::shared_ptr<Flight>, Hash, Equal> inflight;
+    std::uint64_t misses = 0, coalesced = 0, evictions = 0, expirations = 0;
+  };
+
+  //Keeps a reader count of the shard raised so no node can be freed under
+  //us. The count joined must belong to an epoch that was still current once
+  //it was raised; see reclaim().
+  class ReadGuard {
+  public:
+    explicit ReadGuard(const Shard& shard) {
+      for(;;) {
+        const std::uint64_t epoch = shard.epoch.load();
+        readers_ = &shard.readers[epoch & 1];
+        readers_->fetch_add(1);
+        if(shard.epoch.load() == epoch) return;
+        readers_->fetch_sub(1);
+      }
+    }
+    ~ReadGuard() { readers_->fetch_sub(1); }
+  private:
+    std::atomic<std::size_t>* readers_;
+  };
+
+  static std::int64_t nowNs();
+  static bool expired(const Node& node, std::int64_t now) {
+    return node.expiresAt != kNever && now >= node.expiresAt;
+  }
+
+  std::size_t hashOf(const Key& key) const;
+  Shard& shardFor(std::size_t hash) const {
+    if(shardBits_ == 0) return shards_[0];
+    return shards_[hash >> (std::numeric_limits<std::size_t>::digits - shardBits_)];
+  }
+
+  //Returns the slot index holding key, or -1. Safe without the lock.
+  std::ptrdiff_t find(const Shard& shard, std::size_t hash, const Key& key) const;
+  //The remaining helpers need the shard's lock.
+  void insert(Shard& shard, Node* node);
+  void removeAt(Shard& shard, std::size_t index);
+  void evictOne(Shard& shard);
+  void reclaim(Shard& shard);
+
+  const Hash hash_;
+  const Equal equal_;
+  const MemoCacheOptions options_;
+  std::size_t shardBits_;
+  std::size_t shardCount_;
+  std::size_t shardCapacity_;
+  std::size_t slotMask_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+
+/******************************************************************************
+ ******************************************************************************
+ *******************************INLINE FUNCTIONS*******************************
+ ******************************************************************************
+ *****************************************************************************/
+
+template<typename Key, typename V, typename Hash, typename Equal>
+constexpr std::int64_t MemoCache<Key, Expected<V>, Hash, Equal>::kNever;
+
+template<typename Key, typename V, typename Hash, typename Equal>
+MemoCache<Key, Expected<V>, Hash, Equal>::MemoCache(std::size_t capacity,
+    MemoCacheOptions options, Hash hash, Equal equal)
+  : hash_(hash), equal_(equal), options_(options), shardBits_(0)
+{
+  while((std::size_t(1) << shardBits_) < std::max<std::size_t>(options.shards, 1)) {
+    ++shardBits_;
+  }
+  shardCount_ = std::size_t(1) << shardBits_;
+  shardCapacity_ = std::max<std::size_t>((capacity + shardCount_ - 1) / shardCount_, 1);
+
+  //Keep the load factor at or below one half so probes stay short.
+  std::size_t slots = 2;
+  while(slots < 2 * shardCapacity_) slots <<= 1;
+  slotMask_ = slots - 1;
+
+  shards_.reset(new Shard[shardCount_]);
+  for(std::size_t s = 0; s < shardCount_; ++s) {
+    Shard& shard = shards_[s];
+    shard.epoch.store(0);
+    shard.readers[0].store(0);
+    shard.readers[1].store(0);
+    shard.hits.store(0);
+    shard.slots.reset(new std::atomic<Node*>[slots]);
+    for(std::size_t i = 0; i < slots; ++i) shard.slots[i].store(nullptr);
+  }
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+MemoCache<Key, Expected<V>, Hash, Equal>::~MemoCache() {
+  for(std::size_t s = 0; s < shardCount_; ++s) {
+    Shard& shard = shards_[s];
+    for(std::size_t i = 0; i <= slotMask_; ++i) delete shard.slots[i].load();
+    for(Node* node : shard.retired) delete node;
+    for(Node* node : shard.draining) delete node;
+  }
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+std::int64_t MemoCache<Key, Expected<V>, Hash, Equal>::nowNs() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+std::size_t MemoCache<Key, Expected<V>, Hash, Equal>::hashOf(const Key& key) const {
+  //Fibonacci hashing: std::hash is often the identity, and both the shard
+  //(top bits) and the slot (low bits) need well mixed bits.
+  const std::uint64_t mixed = static_cast<std::uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+  return static_cast<std::size_t>(mixed ^ (mixed >> 32));
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+std::ptrdiff_t MemoCache<Key, Expected<V>, Hash, Equal>::find(
+    const Shard& shard, std::size_t hash, const Key& key) const {
+  std::size_t index = hash & slotMask_;
+  for(std::size_t probes = 0; probes <= slotMask_; ++probes) {
+    const Node* node = shard.slots[index].load();
+    if(!node) return -1;
+    if(node->hash == hash && equal_(node->key, key)) return index;
+    index = (index + 1) & slotMask_;
+  }
+  return -1;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+bool MemoCache<Key, Expected<V>, Hash, Equal>::peek(
+    const Key& key, Expected<V>& out) const {
+  const std::size_t hash = hashOf(key);
+  const Shard& shard = shardFor(hash);
+  ReadGuard guard(shard);
+  const std::ptrdiff_t index = find(shard, hash, key);
+  if(index < 0) return false;
+  const Node* node = shard.slots[index].load();
+  //The slot may have been reused since find(); check again.
+  if(!node || node->hash != hash || !equal_(node->key, key)) return false;
+  if(expired(*node, nowNs())) return false;
+  if(!node->referenced.load(std::memory_order_relaxed)) {
+    node->referenced.store(true, std::memory_order_relaxed);
+  }
+  out = node->value;
+  return true;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+template<typename FUNC>
+Expected<V> MemoCache<Key, Expected<V>, Hash, Equal>::get(const Key& key, FUNC compute) {
+  {
+    //Fast path: no lock.
+    const std::size_t hash = hashOf(key);
+    const Shard& shard = shardFor(hash);
+    ReadGuard guard(shard);
+    const std::ptrdiff_t index = find(shard, hash, key);
+    if(index >= 0) {
+      const Node* node = shard.slots[index].load();
+      if(node && node->hash == hash && equal_(node->key, key) &&
+         !expired(*node, nowNs())) {
+        if(!node->referenced.load(std::memory_order_relaxed)) {
+          node->referenced.store(true, std::memory_order_relaxed);
+        }
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        return node->value;
+      }
+    }
+  }
+
+  const std::size_t hash = hashOf(key);
+  Shard& shard = shardFor(hash);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+
+  const std::ptrdiff_t index = find(shard, hash, key);
+  if(index >= 0) {
+    const Node* node = shard.slots[index].load();
+    if(!expired(*node, nowNs())) {
+      node->referenced.store(true, std::memory_order_relaxed);
+      shard.hits.fetch_add(1, std::memory_order_relaxed);
+      return node->value;
+    }
+    ++shard.expirations;
+    removeAt(shard, index);
+  }
+
+  auto existing = shard.inflight.find(key);
+  if(existing != shard.inflight.end()) {
+    ++shard.coalesced;
+    std::shared_ptr<Flight> flight = existing->second;
+    flight->cv.wait(lock, [&flight]() { return flight->done; });
+    if(!flight->result) return Expected<V>(flight->error);
+    return *flight->result;
+  }
+
+  ++shard.misses;
+  std::shared_ptr<Flight> flight = std::make_shared<Flight>();
+  shard.inflight.emplace(key, flight);
+  lock.unlock();
+
+  Expected<V> result = Expected<V>::fromCode(compute);
+
+  lock.lock();
+  try {
+    flight->result.reset(new Expected<V>(result));
+    const auto ttl = result.valid() ? options_.valueTtl : options_.errorTtl;
+    if(ttl > std::chrono::nanoseconds::zero()) {
+      const std::int64_t now = nowNs();
+      const std::int64_t expiry =
+        ttl.count() >= kNever - now ? kNever : now + ttl.count();
+      //erase() or clear() may have run meanwhile, but nothing else inserts
+      //this key while our flight is registered.
+      if(shard.size >= shardCapacity_) evictOne(shard);
+      insert(shard, new Node(hash, key, result, expiry));
+    }
+  } catch(...) {
+    //The result just goes uncached, but the flight must still land: its
+    //waiters, and every later get() of the key, would block forever.
+    if(!flight->result) flight->error = std::current_exception();
+  }
+  flight->done = true;
+  shard.inflight.erase(key);
+  reclaim(shard);
+  lock.unlock();
+  flight->cv.notify_all();
+  return result;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::erase(const Key& key) {
+  const std::size_t hash = hashOf(key);
+  Shard& shard = shardFor(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const std::ptrdiff_t index = find(shard, hash, key);
+  if(index >= 0) removeAt(shard, index);
+  reclaim(shard);
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::clear() {
+  for(std::size_t s = 0; s < shardCount_; ++s) {
+    Shard& shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for(std::size_t i = 0; i <= slotMask_; ++i) {
+      if(Node* node = shard.slots[i].load()) {
+        shard.slots[i].store(nullptr);
+        shard.retired.push_back(node);
+      }
+    }
+    shard.size = 0;
+    reclaim(shard);
+  }
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+std::size_t MemoCache<Key, Expected<V>, Hash, Equal>::size() const {
+  std::size_t total = 0;
+  for(std::size_t s = 0; s < shardCount_; ++s) {
+    std::lock_guard<std::mutex> lock(shards_[s].mutex);
+    total += shards_[s].size;
+  }
+  return total;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+MemoCacheStats MemoCache<Key, Expected<V>, Hash, Equal>::stats() const {
+  MemoCacheStats total;
+  for(std::size_t s = 0; s < shardCount_; ++s) {
+    Shard& shard = shards_[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total.hits += shard.hits.load(std::memory_order_relaxed);
+    total.misses += shard.misses;
+    total.coalesced += shard.coalesced;
+    total.evictions += shard.evictions;
+    total.expirations += shard.expirations;
+  }
+  return total;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::insert(Shard& shard, Node* node) {
+  std::size_t index = node->hash & slotMask_;
+  while(shard.slots[index].load()) index = (index + 1) & slotMask_;
+  shard.slots[index].store(node);
+  ++shard.size;
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::removeAt(Shard& shard, std::size_t index) {
+  shard.retired.push_back(shard.slots[index].load());
+  shard.slots[index].store(nullptr);
+  --shard.size;
+
+  //Backward shift deletion: pull later members of the probe run into the
+  //hole so lookups never need tombstones. An entry is moved by publishing it
+  //in its new slot before clearing its old one.
+  std::size_t hole = index;
+  for(std::size_t next = (hole + 1) & slotMask_; ; next = (next + 1) & slotMask_) {
+    Node* node = shard.slots[next].load();
+    if(!node) return;
+    const std::size_t home = node->hash & slotMask_;
+    //Movable unless its home lies cyclically in (hole, next].
+    const bool homeAfterHole = hole <= next
+      ? (home > hole && home <= next)
+      : (home > hole || home <= next);
+    if(homeAfterHole) continue;
+    shard.slots[hole].store(node);
+    shard.slots[next].store(nullptr);
+    hole = next;
+  }
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::evictOne(Shard& shard) {
+  for(;;) {
+    const std::size_t index = shard.hand;
+    shard.hand = (shard.hand + 1) & slotMask_;
+    Node* node = shard.slots[index].load();
+    if(!node) continue;
+    if(node->referenced.load(std::memory_order_relaxed)) {
+      node->referenced.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    ++shard.evictions;
+    removeAt(shard, index);
+    return;
+  }
+}
+
+template<typename Key, typename V, typename Hash, typename Equal>
+void MemoCache<Key, Expected<V>, Hash, Equal>::reclaim(Shard& shard) {
+  //A reader can only see a node if it raised its count before the node was
+  //unlinked (all sequentially consistent), during an epoch that was current
+  //at the time. The draining nodes were unlinked before the last epoch
+  //change, which in turn came after the epoch before that had drained, so
+  //the only readers that can still see them are counted in the previous
+  //epoch's count. Once that is zero they can go, and the retired ones take
+  //their place in a new epoch.
+  for(int round = 0; round < 2; ++round) {
+    const std::uint64_t epoch = shard.epoch.load();
+    if(!shard.draining.empty()) {
+      if(shard.readers[(epoch + 1) & 1].load() != 0) return;
+      for(Node* node : shard.draining) delete node;
+      shard.draining.clear();
+    }
+    if(shard.retired.empty()) return;
+    shard.draining.swap(shard.retired);
+    shard.epoch.store(epoch + 1);
+  }
+}
+
+} //namespace mex
@@ -0,0 +1,374 @@
+#include "ShmChannel.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queues.h"
+#include "std_oversights.h"
+
+using std::atomic;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::string;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_seq_cst;
+
+namespace mex {
+namespace detail {
+
+//Lives at the start of the mapping. Everything in it must be address free,
+//since each process maps it somewhere else.
+struct ShmControl {
+  atomic<uint64_t> magic; //Stored last by the creator.
+  uint64_t typeCheck;
+  uint64_t slotSize;
+  uint64_t slotCount;
+
+  //Held by the attached thread of each side for as long as it is attached.
+  pthread_mutex_t senderLock;
+  pthread_mutex_t receiverLock;
+  atomic<uint32_t> senderState;   //A ShmRing::Peer.
+  atomic<uint32_t> receiverState;
+
+  //Written by the sender. dataSeq is the futex the receiver sleeps on.
+  alignas(hardware_destructive_interference_size) atomic<uint64_t> head;
+  atomic<uint32_t> dataSeq;
+  atomic<uint32_t> receiverWaiting;
+
+  //Written by the receiver. spaceSeq is the futex the sender sleeps on.
+  alignas(hardware_destructive_interference_size) atomic<uint64_t> tail;
+  atomic<uint32_t> spaceSeq;
+  atomic<uint32_t> senderWaiting;
+};
+
+namespace {
+
+  static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t) &&
+                ATOMIC_INT_LOCK_FREE == 2, "futex words must be plain ints");
+
+  constexpr uint64_t kMagic = 0x31434d485358454dULL; //"MEXSHMC1"
+  constexpr size_t kSlotsOffset =
+    (sizeof(ShmControl) + hardware_destructive_interference_size - 1) /
+    hardware_destructive_interference_size * hardware_destructive_interference_size;
+  //Rounds of yielding before a waiting side goes to sleep.
+  constexpr int kSpins = 16;
+  //How long a sleeping side waits before checking its peer is alive.
+  constexpr long kLivenessCheckNs = 20 * 1000 * 1000;
+
+  using Peer = ShmRing::Peer;
+
+  [[noreturn]] void throwErrno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+
+  //The mapping is shared between processes, so no FUTEX_PRIVATE_FLAG.
+  void futexWait(atomic<uint32_t>& word, uint32_t expected) {
+    timespec timeout{0, kLivenessCheckNs};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT,
+            expected, &timeout, nullptr, 0);
+  }
+
+  void futexWake(atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE,
+            1, nullptr, nullptr, 0);
+  }
+
+  void initLock(pthread_mutex_t& lock) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_ERRORCHECK);
+    pthread_mutex_init(&lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+  }
+
+  void attachSide(pthread_mutex_t& lock, atomic<uint32_t>& state) {
+    if(state.load(memory_order_acquire) != uint32_t(Peer::Unattached) ||
+       pthread_mutex_trylock(&lock) != 0) {
+      throw std::logic_error("ShmChannel side attached twice");
+    }
+    state.store(uint32_t(Peer::Alive), memory_order_release);
+  }
+
+  void closeSide(pthread_mutex_t& lock, atomic<uint32_t>& state,
+                 atomic<uint32_t>& peerSeq) {
+    state.store(uint32_t(Peer::Closed), memory_order_release);
+    std::atomic_thread_fence(memory_order_seq_cst);
+    peerSeq.fetch_add(1, memory_order_release);
+    futexWake(peerSeq);
+    pthread_mutex_unlock(&lock);
+  }
+
+  //The state word tells an attached side from a closed one; the lock tells a
+  //live attached side from a dead one.
+  Peer sideState(pthread_mutex_t& lock, atomic<uint32_t>& state) {
+    const Peer current = Peer(state.load(memory_order_acquire));
+    if(current != Peer::Alive) return current;
+    const int locked = pthread_mutex_trylock(&lock);
+    //EDEADLK: the side is attached to this very thread.
+    if(locked == EBUSY || locked == EDEADLK) return Peer::Alive;
+    if(locked == EOWNERDEAD) {
+      pthread_mutex_consistent(&lock);
+      uint32_t alive = uint32_t(Peer::Alive);
+      state.compare_exchange_strong(alive, uint32_t(Peer::Died));
+    }
+    if(locked == 0 || locked == EOWNERDEAD) pthread_mutex_unlock(&lock);
+    //Got the lock: the side closed meanwhile (close updates the state first)
+    //or died.
+    const Peer now = Peer(state.load(memory_order_acquire));
+    return now == Peer::Alive ? Peer::Died : now;
+  }
+
+  bool gone(Peer peer) {
+    return peer == Peer::Closed || peer == Peer::Died;
+  }
+
+} //namespace
+
+ShmRing::ShmRing(int fd, size_t slotSize, size_t slotCount, uint64_t typeCheck)
+  : fd_(fd), control_(nullptr), slots_(nullptr), mappedSize_(0),
+    slotSize_(slotSize), slotCount_(roundUpToPowerOfTwo(slotCount)),
+    sender_(false), receiver_(false), senderPid_(0), receiverPid_(0),
+    cachedHead_(0), cachedTail_(0)
+{
+  const size_t size = kSlotsOffset + slotSize_ * slotCount_;
+  if(ftruncate(fd_, size) != 0) {
+    const int error = errno;
+    ::close(fd_);
+    throw std::system_error(error, std::generic_category(), "ftruncate");
+  }
+  map(size);
+
+  new(control_) ShmControl();
+  control_->typeCheck = typeCheck;
+  control_->slotSize = slotSize_;
+  control_->slotCount = slotCount_;
+  initLock(control_->senderLock);
+  initLock(control_->receiverLock);
+  control_->magic.store(kMagic, memory_order_release);
+}
+
+ShmRing::ShmRing(int fd, size_t slotSize, uint64_t typeCheck)
+  : fd_(fd), control_(nullptr), slots_(nullptr), mappedSize_(0),
+    slotSize_(slotSize), slotCount_(0),
+    sender_(false), receiver_(false), senderPid_(0), receiverPid_(0),
+    cachedHead_(0), cachedTail_(0)
+{
+  struct stat info;
+  if(fstat(fd_, &info) != 0) {
+    const int error = errno;
+    ::close(fd_);
+    throw std::system_error(error, std::generic_category(), "fstat");
+  }
+  if(size_t(info.st_size) < kSlotsOffset) {
+    ::close(fd_);
+    throw std::invalid_argument("not a ShmChannel");
+  }
+  map(info.st_size);
+
+  const bool matches = control_->magic.load(memory_order_acquire) == kMagic &&
+                       control_->typeCheck == typeCheck &&
+                       control_->slotSize == slotSize &&
+                       control_->slotCount != 0 &&
+                       (control_->slotCount & (control_->slotCount - 1)) == 0 &&
+                       kSlotsOffset + control_->slotSize * control_->slotCount <= mappedSize_;
+  if(!matches) {
+    munmap(control_, mappedSize_);
+    ::close(fd_);
+    throw std::invalid_argument("not a ShmChannel of this type and message length");
+  }
+  slotCount_ = control_->slotCount;
+}
+
+ShmRing::ShmRing(ShmRing&& rhs)
+  : fd_(rhs.fd_), control_(rhs.control_), slots_(rhs.slots_),
+    mappedSize_(rhs.mappedSize_), slotSize_(rhs.slotSize_), slotCount_(rhs.slotCount_),
+    sender_(rhs.sender_), receiver_(rhs.receiver_),
+    senderPid_(rhs.senderPid_), receiverPid_(rhs.receiverPid_),
+    cachedHead_(rhs.cachedHead_), cachedTail_(rhs.cachedTail_)
+{
+  rhs.fd_ = -1;
+  rhs.control_ = nullptr;
+  rhs.sender_ = rhs.receiver_ = false;
+}
+
+ShmRing::~ShmRing() {
+  if(!control_) return;
+  const int pid = getpid();
+  if(senderPid_ == pid) closeSender();
+  if(receiverPid_ == pid) closeReceiver();
+  munmap(control_, mappedSize_);
+  ::close(fd_);
+}
+
+void ShmRing::map(size_t size) {
+  void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if(mapped == MAP_FAILED) {
+    const int error = errno;
+    ::close(fd_);
+    throw std::system_error(error, std::generic_category(), "mmap");
+  }
+  control_ = static_cast<ShmControl*>(mapped);
+  slots_ = static_cast<char*>(mapped) + kSlotsOffset;
+  mappedSize_ = size;
+}
+
+void ShmRing::attachSender() {
+  attachSide(control_->senderLock, control_->senderState);
+  sender_ = true;
+  senderPid_ = getpid();
+  cachedTail_ = control_->tail.load(memory_order_acquire);
+}
+
+void ShmRing::attachReceiver() {
+  attachSide(control_->receiverLock, control_->receiverState);
+  receiver_ = true;
+  receiverPid_ = getpid();
+  cachedHead_ = control_->head.load(memory_order_acquire);
+}
+
+void ShmRing::closeSender() {
+  if(!sender_) return;
+  closeSide(control_->senderLock, control_->senderState, control_->dataSeq);
+  sender_ = false;
+}
+
+void ShmRing::closeReceiver() {
+  if(!receiver_) return;
+  closeSide(control_->receiverLock, control_->receiverState, control_->spaceSeq);
+  receiver_ = false;
+}
+
+ShmRing::Peer ShmRing::senderState() const {
+  return sideState(control_->senderLock, control_->senderState);
+}
+
+ShmRing::Peer ShmRing::receiverState() const {
+  return sideState(control_->receiverLock, control_->receiverState);
+}
+
+char* ShmRing::beginWrite(bool block, Peer& peer) {
+  const uint64_t head = control_->head.load(memory_order_relaxed);
+  auto slot = [&]() { return slots_ + (head & (slotCount_ - 1)) * slotSize_; };
+
+  //A clean close is a single load to notice; a death only matters (and is
+  //only checked for) once the ring is full.
+  peer = Peer(control_->receiverState.load(memory_order_acquire));
+  if(gone(peer)) return nullptr;
+  if(head - cachedTail_ < slotCount_) return slot();
+  cachedTail_ = control_->tail.load(memory_order_acquire);
+  if(head - cachedTail_ < slotCount_) return slot();
+
+  for(int round = 0; ; ++round) {
+    peer = receiverState();
+    if(gone(peer) || !block) return nullptr;
+    if(round < kSpins) {
+      std::this_thread::yield();
+      cachedTail_ = control_->tail.load(memory_order_acquire);
+    } else {
+      //Announce the wait, then look again, so the receiver either sees the
+      //flag or the sender sees its progress (the fences pair up Dekker style).
+      const uint32_t seq = control_->spaceSeq.load(memory_order_acquire);
+      control_->senderWaiting.store(1, memory_order_seq_cst);
+      cachedTail_ = control_->tail.load(memory_order_seq_cst);
+      if(head - cachedTail_ >= slotCount_) futexWait(control_->spaceSeq, seq);
+      control_->senderWaiting.store(0, memory_order_relaxed);
+      cachedTail_ = control_->tail.load(memory_order_acquire);
+    }
+    if(head - cachedTail_ < slotCount_) return slot();
+  }
+}
+
+void ShmRing::commitWrite() {
+  const uint64_t head = control_->head.load(memory_order_relaxed);
+  control_->head.store(head + 1, memory_order_release);
+  std::atomic_thread_fence(memory_order_seq_cst);
+  if(control_->receiverWaiting.load(memory_order_relaxed)) {
+    control_->dataSeq.fetch_add(1, memory_order_release);
+    futexWake(control_->dataSeq);
+  }
+}
+
+const char* ShmRing::beginRead(bool block, Peer& peer) {
+  const uint64_t tail = control_->tail.load(memory_order_relaxed);
+  auto slot = [&]() { return slots_ + (tail & (slotCount_ - 1)) * slotSize_; };
+
+  peer = Peer::Alive;
+  if(tail != cachedHead_) return slot();
+  cachedHead_ = control_->head.load(memory_order_acquire);
+  if(tail != cachedHead_) return slot();
+
+  for(int round = 0; ; ++round) {
+    peer = senderState();
+    if(gone(peer)) {
+      //Whatever was pushed before the sender went is still to be had.
+      cachedHead_ = control_->head.load(memory_order_acquire);
+      return tail != cachedHead_ ? slot() : nullptr;
+    }
+    if(!block) return nullptr;
+    if(round < kSpins) {
+      std::this_thread::yield();
+      cachedHead_ = control_->head.load(memory_order_acquire);
+    } else {
+      const uint32_t seq = control_->dataSeq.load(memory_order_acquire);
+      control_->receiverWaiting.store(1, memory_order_seq_cst);
+      cachedHead_ = control_->head.load(memory_order_seq_cst);
+      if(tail == cachedHead_) futexWait(control_->dataSeq, seq);
+      control_->receiverWaiting.store(0, memory_order_relaxed);
+      cachedHead_ = control_->head.load(memory_order_acquire);
+    }
+    if(tail != cachedHead_) return slot();
+  }
+}
+
+void ShmRing::commitRead() {
+  const uint64_t tail = control_->tail.load(memory_order_relaxed);
+  control_->tail.store(tail + 1, memory_order_release);
+  std::atomic_thread_fence(memory_order_seq_cst);
+  if(control_->senderWaiting.load(memory_order_relaxed)) {
+    control_->spaceSeq.fetch_add(1, memory_order_release);
+    futexWake(control_->spaceSeq);
+  }
+}
+
+int createMemfd() {
+  const int fd = memfd_create("mex.ShmChannel", MFD_CLOEXEC);
+  if(fd < 0) throwErrno("memfd_create");
+  return fd;
+}
+
+int createNamedShm(const string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0) throwErrno("shm_open");
+  return fd;
+}
+
+int openNamedShm(const string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if(fd < 0) throwErrno("shm_open");
+  return fd;
+}
+
+void unlinkNamedShm(const string& name) {
+  shm_unlink(name.c_str());
+}
+
+} //namespace detail
+} //namespace mex
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Expected.h"
+#include "wire.h"
+
+/*
+ *********************************OVERVIEW*************************************
+ * ShmChannel<T> streams Expected<T> results from one process to another on
+ * the same machine (Linux only) through a ring buffer in shared memory. The
+ * typical use is to run crash-prone work (parsing untrusted input, say) in a
+ * forked worker: the worker pushes its results, the parent pops them, and if
+ * the worker dies the parent gets an Expected holding a PeerDied exception
+ * instead of hanging or crashing itself.
+ *
+ * Each result is encoded with mex::wire straight into its ring slot and
+ * decoded straight out of it, so nothing is copied through the kernel. T must
+ * therefore be trivially copyable, and an error travels as its type tag, code
+ * and message (see wire.h; register application exceptions with the global
+ * ErrorRegistry in both processes). Each slot holds messages of at least the
+ * channel's maxMessageLength; longer ones are truncated.
+ *
+ * The channel is single producer, single consumer: one sender thread in one
+ * process, one receiver thread in another (or the same) process. Use one
+ * channel per worker. A side attaches on its first push/pop, or explicitly
+ * via attachSender/attachReceiver; a worker should attach first thing, since
+ * its death can only be noticed once it has attached. Everything else about a
+ * side - closing it, and noticing its death - is tied to the thread that
+ * attached, which holds a process-shared robust mutex for as long as it is
+ * attached. The kernel releases that mutex when the thread dies, which is how
+ * the other side learns of a crash.
+ *
+ * Back-pressure: push blocks while the ring is full. Both sides yield briefly
+ * and then sleep on a futex, so an idle channel costs no CPU; a sleeping side
+ * wakes up every few milliseconds to check that its peer is still alive.
+ *    * pop() returns an Expected holding ChannelClosed once the sender has
+ *      closed and everything it pushed has been popped, or PeerDied if it died
+ *      instead. Results pushed before a crash are still delivered.
+ *    * push() throws ChannelClosed or PeerDied if the receiver is gone.
+ *    * A slot that does not decode (a sender scribbling over the ring before
+ *      dying, say) is popped as an Expected holding wire::FormatError, and the
+ *      channel moves on to the next one.
+ *    * tryPush and tryPop never wait, but otherwise report a gone peer the
+ *      same way: tryPush throws, and tryPop returns true with result holding
+ *      ChannelClosed or PeerDied. They return false only if the ring is full
+ *      (or empty) and the peer may still make room (or push).
+ *
+ * Channels live either in an anonymous memfd (the constructor), which forked
+ * children inherit and whose fd() can be handed to unrelated processes over a
+ * Unix socket, or in a named POSIX shared memory object (createNamed and
+ * openNamed; remove the name with unlinkNamed once both sides are open).
+ *
+ ********************************EXAMPLE***************************************
+ *
+   mex::ShmChannel<Record> channel(1024);
+   pid_t pid = fork();
+   if(pid == 0) {
+     channel.attachSender();
+     for(const auto& line : lines) channel.push(Expected<Record>::fromCode(
+       [&]() -> Expected<Record> { return parse(line); }));
+     channel.closeSender();
+     _exit(0);
+   }
+   for(auto r = channel.pop(); !r.hasException<mex::ChannelClosed>(); r = channel.pop()) {
+     if(r.hasException<mex::PeerDied>()) { restartWorker(); break; }
+     use(r);
+   }
+ */
+
+namespace mex {
+
+class ChannelClosed : public std::runtime_error {
+public:
+  explicit ChannelClosed(const std::string& what) : std::runtime_error(what) {}
+};
+
+class PeerDied : public std::runtime_error {
+public:
+  explicit PeerDied(const std::string& what) : std::runtime_error(what) {}
+};
+
+namespace detail {
+
+  struct ShmControl;
+
+  //The type independent part of ShmChannel: the shared mapping and the ring
+  //of fixed size slots in it, along with the waiting and liveness protocol.
+  class ShmRing {
+  public:
+    enum class Peer { Unattached, Alive, Closed, Died };
+
+    //Creates a ring in the given (empty) shared memory object, taking
+    //ownership of fd.
+    ShmRing(int fd, std::size_t slotSize, std::size_t slotCount,
+            std::uint64_t typeCheck);
+    //Maps the ring already in fd, taking ownership of fd.
+    ShmRing(int fd, std::size_t slotSize, std::uint64_t typeCheck);
+    ShmRing(ShmRing&& rhs);
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+    ~ShmRing();
+
+    int fd() const { return fd_; }
+    std::size_t slotCount() const { return slotCount_; }
+    std::size_t slotSize() const { return slotSize_; }
+
+    //Throws std::logic_error if the side was attached before.
+    void attachSender();
+    void attachReceiver();
+    bool senderAttached() const { return sender_; }
+    bool receiverAttached() const { return receiver_; }
+    void closeSender();
+    void closeReceiver();
+
+    //Sender side: the next free slot, or nullptr if the ring is full (and
+    //block is false) or the receiver is gone (peer says why).
+    char* beginWrite(bool block, Peer& peer);
+    void commitWrite();
+
+    //Receiver side: the oldest filled slot, or nullptr if there is none (and
+    //block is false) or the sender is gone and none are left.
+    const char* beginRead(bool block, Peer& peer);
+    void commitRead();
+
+  private:
+    void map(std::size_t size);
+    Peer senderState() const;
+    Peer receiverState() const;
+
+    int fd_;
+    ShmControl* control_;
+    char* slots_;
+    std::size_t mappedSize_;
+    std::size_t slotSize_;
+    std::size_t slotCount_;
+    bool sender_;
+    bool receiver_;
+    //Of the attaching processes; a forked copy must not close the sides.
+    int senderPid_;
+    int receiverPid_;
+    //Each side's copy of the other side's index, as in SpscRing.
+    std::uint64_t cachedHead_;
+    std::uint64_t cachedTail_;
+  };
+
+  int createMemfd();
+  int createNamedShm(const std::string& name);
+  int openNamedShm(const std::string& name);
+  void unlinkNamedShm(const std::string& name);
+
+} //namespace detail
+
+template<typename T>
+class ShmChannel {
+public:
+  //capacity is rounded up to a power of two.
+  explicit ShmChannel(std::size_t capacity, std::size_t maxMessageLength = 240);
+
+  static ShmChannel createNamed(const std::string& name, std::size_t capacity,
+                                std::size_t maxMessageLength = 240);
+  //The channel must have been created with the same T and maxMessageLength.
+  static ShmChannel openNamed(const std::string& name,
+                              std::size_t maxMessageLength = 240);
+  static void unlinkNamed(const std::string& name);
+  //Takes ownership of fd, which must come from another channel's fd().
+  static ShmChannel fromFd(int fd, std::size_t maxMessageLength = 240);
+
+  ShmChannel(ShmChannel&&) = default;
+
+  int fd() const { return ring_.fd(); }
+  std::size_t capacity() const { return ring_.slotCount(); }
+
+  void attachSender() { ring_.attachSender(); }
+  void attachReceiver() { ring_.attachReceiver(); }
+
+  //Sender side. tryPush returns false if the ring is full.
+  bool tryPush(const Expected<T>& result);
+  void push(const Expected<T>& result);
+
+  //Receiver side. tryPop returns false if nothing is waiting.
+  bool tryPop(Expected<T>& result);
+  Expected<T> pop();
+
+  //End a side cleanly. Must be called from the thread that attached it; a
+  //side that simply exits looks as if it died.
+  void closeSender() { ring_.closeSender(); }
+  void closeReceiver() { ring_.closeReceiver(); }
+
+private:
+  ShmChannel(detail::ShmRing ring) : ring_(std::move(ring)) {}
+
+  static std::size_t slotSize(std::size_t maxMessageLength) {
+    return wire::recordCapacity<T>(maxMessageLength);
+  }
+  static std::uint64_t typeCheck() {
+    return (std::uint64_t(sizeof(T)) << 32) | alignof(T);
+  }
+  static bool gone(detail::ShmRing::Peer peer) {
+    return peer == detail::ShmRing::Peer::Closed || peer == detail::ShmRing::Peer::Died;
+  }
+  static Expected<T> goneError(detail::ShmRing::Peer peer);
+  //Decodes the slot beginRead returned and releases it.
+  Expected<T> take(const char* slot);
+
+  detail::ShmRing ring_;
+};
+
+
+/******************************************************************************
+ ******************************************************************************
+ *******************************INLINE FUNCTIONS*******************************
+ ******************************************************************************
+ *****************************************************************************/
+
+template<typename T>
+ShmChannel<T>::ShmChannel(std::size_t capacity, std::size_t maxMessageLength)
+  : ring_(detail::createMemfd(), slotSize(maxMessageLength), capacity, typeCheck()) {}
+
+template<typename T>
+ShmChannel<T> ShmChannel<T>::createNamed(const std::string& name, std::size_t capacity,
+                                         std::size_t maxMessageLength) {
+  return ShmChannel(detail::ShmRing(detail::createNamedShm(name),
+                                    slotSize(maxMessageLength), capacity, typeCheck()));
+}
+
+template<typename T>
+ShmChannel<T> ShmChannel<T>::openNamed(const std::string& name,
+                                       std::size_t maxMessageLength) {
+  return ShmChannel(detail::ShmRing(detail::openNamedShm(name),
+                                    slotSize(maxMessageLength), typeCheck()));
+}
+
+template<typename T>
+void ShmChannel<T>::unlinkNamed(const std::string& name) {
+  detail::unlinkNamedShm(name);
+}
+
+template<typename T>
+ShmChannel<T> ShmChannel<T>::fromFd(int fd, std::size_t maxMessageLength) {
+  return ShmChannel(detail::ShmRing(fd, slotSize(maxMessageLength), typeCheck()));
+}
+
+template<typename T>
+bool ShmChannel<T>::tryPush(const Expected<T>& result) {
+  if(!ring_.senderAttached()) ring_.attachSender();
+  detail::ShmRing::Peer peer;
+  char* slot = ring_.beginWrite(false, peer);
+  if(!slot) {
+    if(gone(peer)) goneError(peer).throwException();
+    return false;
+  }
+  wire::encodeInPlace(result, slot, ring_.slotSize());
+  ring_.commitWrite();
+  return true;
+}
+
+template<typename T>
+void ShmChannel<T>::push(const Expected<T>& result) {
+  if(!ring_.senderAttached()) ring_.attachSender();
+  detail::ShmRing::Peer peer;
+  char* slot = ring_.beginWrite(true, peer);
+  if(!slot) goneError(peer).throwException();
+  wire::encodeInPlace(result, slot, ring_.slotSize());
+  ring_.commitWrite();
+}
+
+template<typename T>
+bool ShmChannel<T>::tryPop(Expected<T>& result) {
+  if(!ring_.receiverAttached()) ring_.attachReceiver();
+  detail::ShmRing::Peer peer;
+  const char* slot = ring_.beginRead(false, peer);
+  if(!slot) {
+    if(!gone(peer)) return false;
+    result = goneError(peer);
+    return true;
+  }
+  result = take(slot);
+  return true;
+}
+
+template<typename T>
+Expected<T> ShmChannel<T>::pop() {
+  if(!ring_.receiverAttached()) ring_.attachReceiver();
+  detail::ShmRing::Peer peer;
+  const char* slot = ring_.beginRead(true, peer);
+  if(!slot) return goneError(peer);
+  return take(slot);
+}
+
+template<typename T>
+Expected<T> ShmChannel<T>::take(const char* slot) {
+  //A corrupt slot must not wedge the channel: report it and move past it.
+  auto result = Expected<T>::fromCode([&]() {
+    return wire::RecordView<T>(slot, ring_.slotSize()).toExpected();
+  });
+  ring_.commitRead();
+  return result;
+}
+
+template<typename T>
+Expected<T> ShmChannel<T>::goneError(detail::ShmRing::Peer peer) {
+  if(peer == detail::ShmRing::Peer::Died) return PeerDied("ShmChannel peer died");
+  return ChannelClosed("ShmChannel closed");
+}
+
+} //namespace mex
@@ -25,6 +25,18 @@ Expected<bool> errorIfNotInt(const std::string& s) {
   return true;
 }
 
+//Copies throw while armed, to check assignment stays consistent.
+struct ThrowingCopy {
+  static bool armed;
+  int value;
+  explicit ThrowingCopy(int v) : value(v) {}
+  ThrowingCopy(const ThrowingCopy& rhs) : value(rhs.value) {
+    if(armed) throw std::runtime_error("copy failed");
+  }
+  ThrowingCopy& operator=(const ThrowingCopy&) = default;
+};
+bool ThrowingCopy::armed = false;
+
 
 int main(int argc, char** argv) {
 
@@ -91,6 +103,26 @@ int main(int argc, char** argv) {
 
 
 
+  //Assigning a value over an exception leaves the exception in place if
+  //copying the value throws:
+  Expected<ThrowingCopy> source(ThrowingCopy(7));
+  Expected<ThrowingCopy> target(std::invalid_argument("before"));
+  ThrowingCopy::armed = true;
+  try {
+    target = source;
+    assert(false);
+  } catch(const std::runtime_error&) {
+  }
+  ThrowingCopy::armed = false;
+  assert(!target.valid());
+  assert(target.hasException<std::invalid_argument>());
+  target = source;
+  assert(target.valid() && target.get().value == 7);
+  target = Expected<ThrowingCopy>(std::out_of_range("after"));
+  assert(target.hasException<std::out_of_range>());
+
+
+
   cout << "All tests completed successfully." << endl;
 
   return 0;
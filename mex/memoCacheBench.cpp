@@ -0,0 +1,148 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+#include "Expected.h"
+#include "MemoCache.h"
+
+/*
+ * MemoCache under contention: 1 to N threads hammer one cache with three
+ * mixes, and the throughput and the cache's own statistics are printed.
+ *    * hits: keys drawn from half the capacity, cache warmed up first, so
+ *      nearly every get() is a lock-free hit.
+ *    * misses: keys drawn from 16 times the capacity, so most get()s compute
+ *      (about a microsecond each) and evict.
+ *    * storm: a cold cache, and every thread asks for the same 16 keys at
+ *      once with a slow computation (a 100 microsecond sleep). Single-flight
+ *      shows as 16 misses however many threads there are, with the other
+ *      threads' requests counted as coalesced, i.e. waiting for the result.
+ *
+ * Usage: memoCacheBench [max threads (default max(4, hardware_concurrency))]
+ *                       [operations per thread (default 200000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::thread;
+
+using mex::Expected;
+using mex::MemoCache;
+using mex::MemoCacheStats;
+
+using Cache = MemoCache<std::uint64_t, Expected<std::uint64_t>>;
+
+const std::size_t kCapacity = 4096;
+
+//The computations being memoized: free, a microsecond of work, and a
+//hundred microsecond wait standing in for a remote call or a disk read.
+std::uint64_t instant(std::uint64_t key) {
+  return key * 3;
+}
+
+std::uint64_t busy(std::uint64_t key) {
+  const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(1);
+  while(std::chrono::steady_clock::now() < until) {}
+  return key * 3;
+}
+
+std::uint64_t waiting(std::uint64_t key) {
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+  return key * 3;
+}
+
+//Runs threads threads doing operations get()s each and returns the seconds
+//taken. Keys are drawn at random from [0, keys), or cycled through in order
+//when there are at most 16 of them.
+double run(Cache& cache, int threads, std::size_t operations, std::uint64_t keys,
+           std::uint64_t (*compute)(std::uint64_t)) {
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  vector<thread> workers;
+  for(int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      std::mt19937_64 gen(t + 1);
+      std::uniform_int_distribution<std::uint64_t> dist(0, keys - 1);
+      ++ready;
+      while(!go.load()) std::this_thread::yield();
+      for(std::size_t i = 0; i < operations; ++i) {
+        const std::uint64_t key = keys <= 16 ? i % keys : dist(gen);
+        if(cache.get(key, [key, compute]() { return compute(key); }).get() != key * 3) {
+          std::abort();
+        }
+      }
+    });
+  }
+  while(ready.load() != threads) std::this_thread::yield();
+  const auto start = std::chrono::steady_clock::now();
+  go = true;
+  for(auto& w : workers) w.join();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(int threads, std::size_t operations, double seconds,
+            const MemoCacheStats& stats) {
+  cout << std::setw(9) << threads << std::fixed << std::setprecision(2)
+       << std::setw(12) << threads * operations / seconds / 1e6
+       << std::setw(12) << stats.hits << std::setw(10) << stats.misses
+       << std::setw(11) << stats.coalesced << std::setw(11) << stats.evictions << endl;
+}
+
+void header(const string& mix) {
+  cout << mix << ":" << endl;
+  cout << "  threads    M gets/s        hits    misses  coalesced  evictions" << endl;
+}
+
+int main(int argc, char** argv) {
+  const int hardware = std::max(1u, thread::hardware_concurrency());
+  const int maxThreads = argc > 1 ? std::atoi(argv[1]) : std::max(4, hardware);
+  const std::size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+  if(maxThreads < 1 || operations < 1) {
+    std::cerr << "usage: memoCacheBench [max threads] [operations per thread]" << endl;
+    return 1;
+  }
+  cout << hardware << " hardware threads, capacity " << kCapacity << ", "
+       << operations << " gets per thread" << endl;
+
+  header("hits");
+  for(int threads = 1; threads <= maxThreads; ++threads) {
+    Cache cache(kCapacity);
+    for(std::uint64_t key = 0; key < kCapacity / 2; ++key) { //Warm up.
+      cache.get(key, [key]() { return instant(key); });
+    }
+    const MemoCacheStats before = cache.stats();
+    const double seconds = run(cache, threads, operations, kCapacity / 2, instant);
+    MemoCacheStats stats = cache.stats();
+    stats.hits -= before.hits;
+    stats.misses -= before.misses;
+    stats.coalesced -= before.coalesced;
+    stats.evictions -= before.evictions;
+    report(threads, operations, seconds, stats);
+  }
+
+  header("misses");
+  for(int threads = 1; threads <= maxThreads; ++threads) {
+    Cache cache(kCapacity);
+    const std::size_t fewer = std::max<std::size_t>(operations / 10, 1);
+    const double seconds = run(cache, threads, fewer, kCapacity * 16, busy);
+    report(threads, fewer, seconds, cache.stats());
+  }
+
+  header("storm");
+  for(int threads = 1; threads <= maxThreads; ++threads) {
+    Cache cache(kCapacity);
+    const double seconds = run(cache, threads, 16, 16, waiting);
+    report(threads, 16, seconds, cache.stats());
+  }
+  return 0;
+}
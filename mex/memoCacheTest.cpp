@@ -0,0 +1,208 @@
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <functional>
+#include <cassert>
+
+#include "Expected.h"
+#include "MemoCache.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::thread;
+using std::atomic;
+
+using mex::Expected;
+using mex::MemoCache;
+using mex::MemoCacheOptions;
+
+//A key whose copies throw while armed, to fail get() after the computation.
+struct FragileKey {
+  static bool armed;
+  int id;
+  explicit FragileKey(int i) : id(i) {}
+  FragileKey(const FragileKey& rhs) : id(rhs.id) {
+    if(armed) throw std::runtime_error("key copy failed");
+  }
+  bool operator==(const FragileKey& rhs) const { return id == rhs.id; }
+};
+bool FragileKey::armed = false;
+
+struct FragileKeyHash {
+  std::size_t operator()(const FragileKey& key) const {
+    return std::hash<int>()(key.id);
+  }
+};
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+MEX_UNIT_TEST
+  MemoCache<int, Expected<string>> cache(100);
+  int calls = 0;
+  auto compute = [&calls]() { ++calls; return string("value"); };
+
+  assert(cache.get(1, compute).get() == "value");
+  assert(cache.get(1, compute).get() == "value");
+  assert(calls == 1);
+  assert(cache.size() == 1);
+
+  Expected<string> peeked = string();
+  assert(cache.peek(1, peeked) && peeked.get() == "value");
+  assert(!cache.peek(2, peeked));
+
+  cache.erase(1);
+  assert(!cache.peek(1, peeked));
+  cache.get(1, compute);
+  assert(calls == 2);
+
+  const auto stats = cache.stats();
+  assert(stats.hits == 1 && stats.misses == 2);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Errors are not cached by default; with an errorTtl they are, until it ends.
+  int calls = 0;
+  auto failing = [&calls]() -> Expected<int> {
+    ++calls;
+    throw std::runtime_error("parse error");
+  };
+
+  MemoCache<string, Expected<int>> uncached(10);
+  assert(uncached.get("a", failing).hasException<std::runtime_error>());
+  assert(uncached.get("a", failing).hasException<std::runtime_error>());
+  assert(calls == 2);
+
+  MemoCacheOptions options;
+  options.errorTtl = std::chrono::milliseconds(20);
+  MemoCache<string, Expected<int>> cached(10, options);
+  calls = 0;
+  assert(!cached.get("a", failing).valid());
+  assert(!cached.get("a", failing).valid());
+  assert(calls == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  assert(!cached.get("a", failing).valid());
+  assert(calls == 2);
+  assert(cached.stats().expirations == 1);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //A single shard of four entries: CLOCK keeps recently used keys around.
+  MemoCacheOptions options;
+  options.shards = 1;
+  MemoCache<int, Expected<int>> cache(4, options);
+  auto identity = [](int x) { return [x]() { return x; }; };
+
+  for(int k = 0; k < 4; ++k) cache.get(k, identity(k));
+  cache.get(0, identity(0));
+  cache.get(1, identity(1));
+  cache.get(4, identity(4)); //Evicts 2 or 3, the unreferenced keys.
+
+  Expected<int> out = 0;
+  assert(cache.size() == 4);
+  assert(cache.stats().evictions == 1);
+  assert(cache.peek(0, out) && cache.peek(1, out) && cache.peek(4, out));
+  assert(cache.peek(2, out) != cache.peek(3, out));
+
+  for(int k = 5; k < 100; ++k) cache.get(k, identity(k));
+  assert(cache.size() == 4);
+  assert(cache.peek(99, out) && out.get() == 99);
+
+  cache.clear();
+  assert(cache.size() == 0 && !cache.peek(99, out));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Concurrent misses on one key run the computation once.
+  MemoCache<int, Expected<int>> cache(16);
+  atomic<int> calls(0);
+  atomic<bool> release(false);
+  auto slow = [&]() {
+    ++calls;
+    while(!release.load()) std::this_thread::yield();
+    return 42;
+  };
+
+  vector<thread> threads;
+  for(int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() { assert(cache.get(7, slow).get() == 42); });
+  }
+  while(calls.load() == 0) std::this_thread::yield();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  release = true;
+  for(auto& t : threads) t.join();
+
+  assert(calls.load() == 1);
+  const auto stats = cache.stats();
+  assert(stats.misses == 1);
+  assert(stats.coalesced + stats.hits == 3);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Contention: readers hammer a small cache while keys get evicted.
+  MemoCacheOptions options;
+  options.shards = 4;
+  MemoCache<int, Expected<int>> cache(64, options);
+  vector<thread> threads;
+  for(int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for(int i = 0; i < 20000; ++i) {
+        const int key = (i * 7 + t) % 200;
+        const auto value = cache.get(key, [key]() { return key * 3; });
+        assert(value.get() == key * 3);
+        if(i % 1000 == 0) cache.erase(key);
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+  assert(cache.size() <= cache.capacity());
+  const auto stats = cache.stats();
+  assert(stats.hits + stats.misses + stats.coalesced == 80000);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Caching the result throws: it is still returned, the flight still lands
+  //and the next get() computes again instead of waiting forever.
+  MemoCache<FragileKey, Expected<int>, FragileKeyHash> cache(16);
+  int calls = 0;
+  auto arming = [&calls]() { ++calls; FragileKey::armed = true; return 5; };
+  assert(cache.get(FragileKey(1), arming).get() == 5);
+  FragileKey::armed = false;
+  assert(cache.size() == 0);
+  assert(cache.get(FragileKey(1), [&calls]() { ++calls; return 6; }).get() == 6);
+  assert(calls == 2);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Retired nodes are freed while readers keep hitting the shard without a
+  //break, and none of them is freed under a reader.
+  MemoCacheOptions options;
+  options.shards = 1;
+  MemoCache<int, Expected<string>> cache(8, options);
+  atomic<bool> stop(false);
+  vector<thread> readers;
+  for(int t = 0; t < 3; ++t) {
+    readers.emplace_back([&]() {
+      while(!stop.load()) {
+        assert(cache.get(0, []() { return string(100, 'h'); }).get().size() == 100);
+      }
+    });
+  }
+  for(int i = 1; i < 20000; ++i) {
+    const int key = i % 50 + 1;
+    assert(cache.get(key, [key]() { return string(key, 'x'); }).get().size() == std::size_t(key));
+  }
+  stop = true;
+  for(auto& t : readers) t.join();
+MEX_END_UNIT_TEST
@@ -0,0 +1,303 @@
+
+#include "parallel.h"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::size_t;
+using std::int32_t;
+using std::int64_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::atomic;
+using std::vector;
+using std::deque;
+using std::thread;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::condition_variable;
+using std::exception_ptr;
+using std::function;
+
+namespace mex {
+namespace par {
+
+namespace {
+  //Below this many elements a chunk is not worth handing to another thread.
+  constexpr size_t kMinGrain = 2048;
+
+  //One forkJoin call. Lives on the caller's stack; 'users' counts workers
+  //that may still touch it, and the caller does not return until it is 0.
+  struct Job {
+    const function<void(size_t)>* body;
+    size_t tasks;
+    atomic<size_t> next;
+    atomic<size_t> finished;
+    size_t users; //Guarded by Impl::poolMutex.
+    mutex errorMutex;
+    exception_ptr error;
+  };
+
+  size_t threadsFromEnvironment() {
+    if(const char* env = std::getenv("MEX_PAR_THREADS")) {
+      const long requested = std::atol(env);
+      if(requested > 0) return requested;
+    }
+    return std::max(1u, thread::hardware_concurrency());
+  }
+} //namespace
+
+struct ThreadPool::Impl {
+  size_t threads;
+  vector<thread> workers;
+  mutex poolMutex;
+  condition_variable wake;     //Work arrived or we are stopping.
+  condition_variable finished; //A job may have completed.
+  deque<Job*> jobs;
+  bool stopping = false;
+
+  void runTasks(Job& job) {
+    for(;;) {
+      const size_t task = job.next.fetch_add(1, std::memory_order_relaxed);
+      if(task >= job.tasks) return;
+      try {
+        (*job.body)(task);
+      } catch(...) {
+        lock_guard<mutex> lock(job.errorMutex);
+        if(!job.error) job.error = std::current_exception();
+      }
+      if(job.finished.fetch_add(1, std::memory_order_acq_rel) + 1 == job.tasks) {
+        lock_guard<mutex> lock(poolMutex);
+        finished.notify_all();
+      }
+    }
+  }
+
+  void workerLoop() {
+    unique_lock<mutex> lock(poolMutex);
+    for(;;) {
+      wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if(stopping) return;
+
+      Job* job = jobs.front();
+      if(job->next.load(std::memory_order_relaxed) >= job->tasks) {
+        jobs.pop_front(); //Every task is claimed; nothing left to help with.
+        continue;
+      }
+      ++job->users;
+      lock.unlock();
+      runTasks(*job);
+      lock.lock();
+      if(--job->users == 0) finished.notify_all();
+    }
+  }
+};
+
+ThreadPool::ThreadPool(size_t threads) : impl_(new Impl) {
+  impl_->threads = std::max<size_t>(threads, 1);
+  for(size_t i = 1; i < impl_->threads; ++i) {
+    impl_->workers.emplace_back([this]() { impl_->workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(impl_->poolMutex);
+    impl_->stopping = true;
+  }
+  impl_->wake.notify_all();
+  for(auto& worker : impl_->workers) worker.join();
+}
+
+size_t ThreadPool::size() const {
+  return impl_->threads;
+}
+
+void ThreadPool::forkJoin(size_t tasks, const function<void(size_t)>& body) {
+  if(tasks == 0) return;
+  if(tasks == 1 || impl_->workers.empty()) {
+    //As on the pool: every task runs, and the first exception is rethrown.
+    exception_ptr error;
+    for(size_t i = 0; i < tasks; ++i) {
+      try {
+        body(i);
+      } catch(...) {
+        if(!error) error = std::current_exception();
+      }
+    }
+    if(error) std::rethrow_exception(error);
+    return;
+  }
+
+  Job job;
+  job.body = &body;
+  job.tasks = tasks;
+  job.next.store(0, std::memory_order_relaxed);
+  job.finished.store(0, std::memory_order_relaxed);
+  job.users = 0;
+
+  {
+    lock_guard<mutex> lock(impl_->poolMutex);
+    impl_->jobs.push_back(&job);
+  }
+  impl_->wake.notify_all();
+
+  impl_->runTasks(job);
+
+  {
+    unique_lock<mutex> lock(impl_->poolMutex);
+    auto& jobs = impl_->jobs;
+    auto itr = std::find(jobs.begin(), jobs.end(), &job);
+    if(itr != jobs.end()) jobs.erase(itr);
+    impl_->finished.wait(lock, [&job]() {
+      return job.users == 0 &&
+             job.finished.load(std::memory_order_acquire) == job.tasks;
+    });
+  }
+
+  if(job.error) std::rethrow_exception(job.error);
+}
+
+ThreadPool& ThreadPool::global() {
+  static ThreadPool pool(threadsFromEnvironment());
+  return pool;
+}
+
+namespace detail {
+
+size_t chunkCount(size_t n, size_t grain) {
+  if(n == 0) return 0;
+  const size_t threads = ThreadPool::global().size();
+  if(grain == 0) {
+    if(threads == 1) return 1;
+    grain = std::max(kMinGrain, n / (threads * 4));
+  }
+  return (n + grain - 1) / grain;
+}
+
+//The kernels below keep several independent accumulators so consecutive adds
+//do not wait on each other; without SSE2 the compiler is left to vectorise
+//the four-way scalar version.
+
+#ifdef __SSE2__
+
+int32_t sum(const int32_t* first, const int32_t* last) {
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+  for(; last - first >= 8; first += 8) {
+    acc0 = _mm_add_epi32(acc0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first)));
+    acc1 = _mm_add_epi32(acc1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + 4)));
+  }
+  int32_t lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi32(acc0, acc1));
+  //Unsigned arithmetic: wrap around like the SIMD lanes rather than overflow.
+  uint32_t result = uint32_t(lanes[0]) + uint32_t(lanes[1]) + uint32_t(lanes[2]) + uint32_t(lanes[3]);
+  for(; first != last; ++first) result += uint32_t(*first);
+  return int32_t(result);
+}
+
+int64_t sum(const int64_t* first, const int64_t* last) {
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+  for(; last - first >= 4; first += 4) {
+    acc0 = _mm_add_epi64(acc0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first)));
+    acc1 = _mm_add_epi64(acc1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + 2)));
+  }
+  int64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(acc0, acc1));
+  uint64_t result = uint64_t(lanes[0]) + uint64_t(lanes[1]);
+  for(; first != last; ++first) result += uint64_t(*first);
+  return int64_t(result);
+}
+
+float sum(const float* first, const float* last) {
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  for(; last - first >= 8; first += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_loadu_ps(first));
+    acc1 = _mm_add_ps(acc1, _mm_loadu_ps(first + 4));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+  float result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for(; first != last; ++first) result += *first;
+  return result;
+}
+
+double sum(const double* first, const double* last) {
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  for(; last - first >= 4; first += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(first));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(first + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  double result = lanes[0] + lanes[1];
+  for(; first != last; ++first) result += *first;
+  return result;
+}
+
+const char* findByte(const char* first, const char* last, char value) {
+  const __m128i needle = _mm_set1_epi8(value);
+  for(; last - first >= 16; first += 16) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+    if(mask) return first + __builtin_ctz(mask);
+  }
+  for(; first != last; ++first) {
+    if(*first == value) return first;
+  }
+  return last;
+}
+
+#else
+
+namespace {
+  template<typename T, typename ACC>
+  T sumUnrolled(const T* first, const T* last) {
+    ACC acc[4] = {};
+    for(; last - first >= 4; first += 4) {
+      acc[0] += ACC(first[0]);
+      acc[1] += ACC(first[1]);
+      acc[2] += ACC(first[2]);
+      acc[3] += ACC(first[3]);
+    }
+    ACC result = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for(; first != last; ++first) result += ACC(*first);
+    return T(result);
+  }
+} //namespace
+
+int32_t sum(const int32_t* first, const int32_t* last) {
+  return sumUnrolled<int32_t, uint32_t>(first, last);
+}
+
+int64_t sum(const int64_t* first, const int64_t* last) {
+  return sumUnrolled<int64_t, uint64_t>(first, last);
+}
+
+float sum(const float* first, const float* last) {
+  return sumUnrolled<float, float>(first, last);
+}
+
+double sum(const double* first, const double* last) {
+  return sumUnrolled<double, double>(first, last);
+}
+
+const char* findByte(const char* first, const char* last, char value) {
+  const void* hit = std::memchr(first, value, last - first);
+  return hit ? static_cast<const char*>(hit) : last;
+}
+
+#endif
+
+} //namespace detail
+
+} //namespace par
+} //namespace mex
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/*
+ *********************************OVERVIEW*************************************
+ * mex::par holds parallel counterparts to a handful of <algorithm> and
+ * <numeric> functions, running on a process-wide fork/join thread pool. No
+ * TBB or OpenMP: the pool is a few dozen lines in parallel.cpp.
+ *
+ * All algorithms require random access iterators. Each splits [first, last)
+ * into chunks of at least 'grain' elements (0 picks a grain that yields a few
+ * chunks per thread) and hands the chunks out to the pool; the calling thread
+ * works on chunks too, so calling these from inside another par algorithm is
+ * fine. Inputs smaller than one grain run serially on the calling thread.
+ *
+ * If an invocation of a user supplied function throws, the remaining chunks
+ * still run and the first exception caught is rethrown to the caller.
+ *
+ * Function objects are copied once per chunk and invoked on the copy, so they
+ * need not be callable through a const reference nor be thread safe - only
+ * copyable. mex::not_fn wrappers work as predicates.
+ *
+ * Differences from the serial versions worth knowing:
+ * 1) reduce requires op to be associative; with floating point this means the
+ *    result may differ from std::accumulate in the last bits.
+ * 2) partition is not stable (neither is std::partition).
+ * 3) sort is a stable merge sort and needs a temporary copy of the range (the
+ *    elements are moved into it, so T need only be move constructible).
+ *
+ * Hand vectorised (SSE2, with a portable fallback) kernels are used when:
+ *    * reduce is called with std::plus<T> over pointers to int32_t, int64_t,
+ *      float or double. Pass mex::data(v) and mex::data(v) + mex::size(v)
+ *      rather than v.begin() to get them.
+ *    * find searches for a char in a range given as pointers.
+ *
+ * The pool has std::thread::hardware_concurrency() threads (counting the
+ * caller) unless the MEX_PAR_THREADS environment variable says otherwise; set
+ * it to measure how an algorithm scales.
+ *
+ ********************************EXAMPLE***************************************
+ *
+   std::vector<double> v = load();
+   mex::par::sort(v.begin(), v.end());
+   auto total = mex::par::reduce(mex::data(v), mex::data(v) + v.size(), 0.0,
+                                 std::plus<double>());
+   auto mid = mex::par::partition(v.begin(), v.end(),
+                                  mex::not_fn([](double d) { return d < 0; }));
+ */
+
+namespace mex {
+namespace par {
+
+class ThreadPool {
+public:
+  //'threads' counts the thread calling forkJoin, so 1 means no workers.
+  explicit ThreadPool(std::size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  std::size_t size() const;
+
+  //Calls body(i) for every i in [0, tasks), spread over the pool and the
+  //calling thread, and returns once all calls have finished. Rethrows the
+  //first exception thrown by body.
+  void forkJoin(std::size_t tasks, const std::function<void(std::size_t)>& body);
+
+  static ThreadPool& global();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+namespace detail {
+  //Number of chunks to cut n elements into, given the requested grain.
+  std::size_t chunkCount(std::size_t n, std::size_t grain);
+
+  //Calls body(begin, end) for each chunk of [0, n).
+  template<typename BODY>
+  void forEachChunk(std::size_t n, std::size_t grain, BODY body) {
+    const std::size_t chunks = chunkCount(n, grain);
+    if(chunks <= 1) {
+      if(n) body(std::size_t(0), n);
+      return;
+    }
+    ThreadPool::global().forkJoin(chunks, [&](std::size_t c) {
+      body(n * c / chunks, n * (c + 1) / chunks);
+    });
+  }
+
+  //Vectorised sums, see parallel.cpp.
+  std::int32_t sum(const std::int32_t* first, const std::int32_t* last);
+  std::int64_t sum(const std::int64_t* first, const std::int64_t* last);
+  float sum(const float* first, const float* last);
+  double sum(const double* first, const double* last);
+
+  const char* findByte(const char* first, const char* last, char value);
+
+  //Folds a non-empty chunk into a T, the type of reduce's init, so a wide T
+  //does not overflow in the element type. Overloaded below to hit the
+  //kernels, which are only used when op itself works in the element type.
+  template<typename T, typename It, typename OP>
+  T reduceChunk(It first, It last, OP& op) {
+    T result(*first);
+    for(++first; first != last; ++first) result = op(result, *first);
+    return result;
+  }
+
+  template<typename T, typename E>
+  auto reduceChunk(const E* first, const E* last, std::plus<E>&)
+    -> decltype(sum(first, last)) {
+    return sum(first, last);
+  }
+
+  template<typename T, typename E>
+  auto reduceChunk(E* first, E* last, std::plus<E>&)
+    -> decltype(sum(first, last)) {
+    return sum(first, last);
+  }
+} //namespace detail
+
+template<typename RandomIt, typename OutputIt, typename UnaryOp>
+OutputIt transform(RandomIt first, RandomIt last, OutputIt out, UnaryOp op,
+                   std::size_t grain = 0) {
+  const std::size_t n = last - first;
+  detail::forEachChunk(n, grain, [&](std::size_t b, std::size_t e) {
+    std::transform(first + b, first + e, out + b, UnaryOp(op));
+  });
+  return out + n;
+}
+
+template<typename RandomIt, typename T, typename BinaryOp>
+T reduce(RandomIt first, RandomIt last, T init, BinaryOp op,
+         std::size_t grain = 0) {
+  const std::size_t n = last - first;
+  const std::size_t chunks = detail::chunkCount(n, grain);
+  if(chunks <= 1) {
+    for(; first != last; ++first) init = op(init, *first);
+    return init;
+  }
+
+  std::vector<std::unique_ptr<T>> partials(chunks);
+  ThreadPool::global().forkJoin(chunks, [&](std::size_t c) {
+    BinaryOp localOp(op);
+    partials[c].reset(new T(detail::reduceChunk<T>(
+      first + n * c / chunks, first + n * (c + 1) / chunks, localOp)));
+  });
+  for(const auto& p : partials) init = op(init, *p);
+  return init;
+}
+
+template<typename RandomIt, typename T>
+T reduce(RandomIt first, RandomIt last, T init) {
+  return par::reduce(first, last, std::move(init), std::plus<T>());
+}
+
+template<typename RandomIt, typename UnaryPredicate>
+typename std::iterator_traits<RandomIt>::difference_type
+count_if(RandomIt first, RandomIt last, UnaryPredicate pred,
+         std::size_t grain = 0) {
+  std::atomic<std::ptrdiff_t> total(0);
+  detail::forEachChunk(last - first, grain, [&](std::size_t b, std::size_t e) {
+    total.fetch_add(std::count_if(first + b, first + e, UnaryPredicate(pred)),
+                    std::memory_order_relaxed);
+  });
+  return total.load();
+}
+
+//Byte search over contiguous memory. Returns last if not found.
+inline const char* find(const char* first, const char* last, char value,
+                        std::size_t grain = 0) {
+  const std::size_t n = last - first;
+  std::atomic<std::size_t> found(n);
+  detail::forEachChunk(n, grain, [&](std::size_t b, std::size_t e) {
+    //Skip the chunk if an earlier one already has a match.
+    if(found.load(std::memory_order_relaxed) < b) return;
+    const char* hit = detail::findByte(first + b, first + e, value);
+    if(hit == first + e) return;
+    std::size_t index = hit - first;
+    std::size_t current = found.load(std::memory_order_relaxed);
+    while(index < current &&
+          !found.compare_exchange_weak(current, index, std::memory_order_relaxed)) {}
+  });
+  return first + found.load();
+}
+
+inline char* find(char* first, char* last, char value, std::size_t grain = 0) {
+  const char* cfirst = first;
+  return first + (par::find(cfirst, static_cast<const char*>(last), value, grain) - cfirst);
+}
+
+template<typename RandomIt, typename UnaryPredicate>
+RandomIt partition(RandomIt first, RandomIt last, UnaryPredicate pred,
+                   std::size_t grain = 0) {
+  const std::size_t n = last - first;
+  const std::size_t chunks = detail::chunkCount(n, grain);
+  if(chunks <= 1) return std::partition(first, last, pred);
+
+  //1) Partition each chunk locally, remembering where its 'true's end.
+  std::vector<std::size_t> begins(chunks + 1), splits(chunks);
+  for(std::size_t c = 0; c <= chunks; ++c) begins[c] = n * c / chunks;
+  ThreadPool::global().forkJoin(chunks, [&](std::size_t c) {
+    splits[c] = std::partition(first + begins[c], first + begins[c + 1],
+                               UnaryPredicate(pred)) - first;
+  });
+
+  //2) Everything left of 'middle' must end up true. Collect the misplaced
+  //   falses left of it and trues right of it; there are equally many.
+  std::size_t middle = 0;
+  for(std::size_t c = 0; c < chunks; ++c) middle += splits[c] - begins[c];
+
+  using Range = std::pair<std::size_t, std::size_t>;
+  std::vector<Range> falses, trues;
+  std::vector<std::size_t> falsePrefix(1, 0), truePrefix(1, 0);
+  for(std::size_t c = 0; c < chunks; ++c) {
+    const std::size_t fBegin = splits[c], fEnd = std::min(begins[c + 1], middle);
+    if(fBegin < fEnd) {
+      falses.emplace_back(fBegin, fEnd);
+      falsePrefix.push_back(falsePrefix.back() + fEnd - fBegin);
+    }
+    const std::size_t tBegin = std::max(begins[c], middle), tEnd = splits[c];
+    if(tBegin < tEnd) {
+      trues.emplace_back(tBegin, tEnd);
+      truePrefix.push_back(truePrefix.back() + tEnd - tBegin);
+    }
+  }
+
+  //3) Swap the k-th misplaced false with the k-th misplaced true.
+  //   Returns the position of the k-th misplaced element.
+  auto locate = [](const std::vector<Range>& ranges,
+                   const std::vector<std::size_t>& prefix, std::size_t k) {
+    const std::size_t r =
+      std::upper_bound(prefix.begin(), prefix.end(), k) - prefix.begin() - 1;
+    return ranges[r].first + (k - prefix[r]);
+  };
+  detail::forEachChunk(falsePrefix.back(), grain, [&](std::size_t b, std::size_t e) {
+    for(std::size_t k = b; k < e; ++k) {
+      std::iter_swap(first + locate(falses, falsePrefix, k),
+                     first + locate(trues, truePrefix, k));
+    }
+  });
+  return first + middle;
+}
+
+template<typename RandomIt, typename Compare>
+void sort(RandomIt first, RandomIt last, Compare comp, std::size_t grain = 0) {
+  const std::size_t n = last - first;
+  std::size_t chunks = detail::chunkCount(n, grain);
+  if(chunks <= 1) {
+    std::stable_sort(first, last, comp);
+    return;
+  }
+
+  //1) Sort runs in place.
+  std::vector<std::size_t> runs(chunks + 1);
+  for(std::size_t c = 0; c <= chunks; ++c) runs[c] = n * c / chunks;
+  ThreadPool::global().forkJoin(chunks, [&](std::size_t c) {
+    std::stable_sort(first + runs[c], first + runs[c + 1], Compare(comp));
+  });
+
+  //2) Merge pairs of runs, ping-ponging between the buffer and the input.
+  //   Each pairwise merge is cut into pieces by splitting the left run and
+  //   binary searching the right one, so late rounds stay parallel.
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  std::vector<T> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+  auto bufferBegin = buffer.begin();
+
+  struct Piece { std::size_t a, aEnd, b, bEnd, out; };
+  bool inBuffer = true;
+  const std::size_t pieceSize = std::max<std::size_t>(n / chunks, 1);
+  while(runs.size() > 2) {
+    std::vector<Piece> pieces;
+    std::vector<std::size_t> merged(1, 0);
+    for(std::size_t r = 0; r + 1 < runs.size(); r += 2) {
+      if(r + 2 >= runs.size()) { //Odd run out: copy it across as is.
+        pieces.push_back(Piece{runs[r], runs[r + 1], runs[r + 1], runs[r + 1], runs[r]});
+        merged.push_back(runs[r + 1]);
+        continue;
+      }
+      const std::size_t aBegin = runs[r], aEnd = runs[r + 1], bEnd = runs[r + 2];
+      std::size_t a = aBegin, b = aEnd;
+      while(a < aEnd) {
+        const std::size_t aNext = std::min(aEnd, a + pieceSize);
+        std::size_t bNext = bEnd;
+        if(aNext < aEnd) {
+          const T& pivot = inBuffer ? bufferBegin[aNext] : first[aNext];
+          bNext = inBuffer
+            ? std::lower_bound(bufferBegin + b, bufferBegin + bEnd, pivot, comp) - bufferBegin
+            : std::lower_bound(first + b, first + bEnd, pivot, comp) - first;
+        }
+        pieces.push_back(Piece{a, aNext, b, bNext, a + b - aEnd});
+        a = aNext;
+        b = bNext;
+      }
+      merged.push_back(bEnd);
+    }
+
+    ThreadPool::global().forkJoin(pieces.size(), [&](std::size_t p) {
+      const Piece& piece = pieces[p];
+      Compare localComp(comp);
+      if(inBuffer) {
+        std::merge(std::make_move_iterator(bufferBegin + piece.a),
+                   std::make_move_iterator(bufferBegin + piece.aEnd),
+                   std::make_move_iterator(bufferBegin + piece.b),
+                   std::make_move_iterator(bufferBegin + piece.bEnd),
+                   first + piece.out, localComp);
+      } else {
+        std::merge(std::make_move_iterator(first + piece.a),
+                   std::make_move_iterator(first + piece.aEnd),
+                   std::make_move_iterator(first + piece.b),
+                   std::make_move_iterator(first + piece.bEnd),
+                   bufferBegin + piece.out, localComp);
+      }
+    });
+    runs.swap(merged);
+    inBuffer = !inBuffer;
+  }
+
+  if(inBuffer) {
+    detail::forEachChunk(n, grain, [&](std::size_t b, std::size_t e) {
+      std::move(bufferBegin + b, bufferBegin + e, first + b);
+    });
+  }
+}
+
+template<typename RandomIt>
+void sort(RandomIt first, RandomIt last) {
+  par::sort(first, last,
+            std::less<typename std::iterator_traits<RandomIt>::value_type>());
+}
+
+} //namespace par
+} //namespace mex
@@ -0,0 +1,152 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "std_oversights.h"
+
+/*
+ * Scaling curves for mex::par: each algorithm is timed with the pool sized
+ * to 1, 2, ... N threads, and the time and the speedup over one thread are
+ * printed. The pool reads MEX_PAR_THREADS once, so every thread count runs in
+ * a forked child that sets it first.
+ *
+ * Usage: parallelBench [max threads (default hardware_concurrency)]
+ *                      [elements (default 8000000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+
+using mex::data;
+
+namespace par = mex::par;
+
+const char* const kNames[] = {
+  "sort", "transform", "reduce", "count_if", "partition", "find"
+};
+const int kAlgorithms = sizeof(kNames) / sizeof(kNames[0]);
+
+//Best of a few runs, in milliseconds; setup() restores the input each time.
+template<typename SETUP, typename RUN>
+double bestOf(SETUP setup, RUN run) {
+  double best = 1e300;
+  for(int i = 0; i < 3; ++i) {
+    setup();
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+    best = std::min(best, took.count());
+  }
+  return best;
+}
+
+//Runs in the child, with the pool already sized.
+void measure(std::size_t n, double* ms) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(-1000000, 1000000);
+  vector<int> input(n);
+  for(auto& x : input) x = dist(gen);
+  vector<int> work(n);
+  vector<double> out(n);
+  string haystack(n, 'a');
+  haystack[n - 1] = 'b';
+  volatile std::int64_t sink = 0; //Keeps the results alive.
+
+  auto restore = [&]() { std::copy(input.begin(), input.end(), work.begin()); };
+  auto none = []() {};
+
+  ms[0] = bestOf(restore, [&]() { par::sort(work.begin(), work.end()); });
+  ms[1] = bestOf(none, [&]() {
+    par::transform(input.begin(), input.end(), out.begin(),
+                   [](int x) { return x * 0.5 + 1.0; });
+  });
+  ms[2] = bestOf(none, [&]() {
+    sink += par::reduce(data(input), data(input) + n, std::int32_t(0),
+                        std::plus<std::int32_t>());
+  });
+  ms[3] = bestOf(none, [&]() {
+    sink += par::count_if(input.begin(), input.end(), [](int x) { return x % 3 == 0; });
+  });
+  ms[4] = bestOf(restore, [&]() {
+    par::partition(work.begin(), work.end(), [](int x) { return x < 0; });
+  });
+  ms[5] = bestOf(none, [&]() {
+    sink += par::find(haystack.data(), haystack.data() + n, 'b') - haystack.data();
+  });
+}
+
+//Forks a child that sizes the pool to threads and reports its timings
+//through a pipe.
+bool measureWith(int threads, std::size_t n, double* ms) {
+  int fds[2];
+  if(pipe(fds) != 0) return false;
+  const pid_t pid = fork();
+  if(pid == 0) {
+    close(fds[0]);
+    setenv("MEX_PAR_THREADS", std::to_string(threads).c_str(), 1);
+    double result[kAlgorithms];
+    measure(n, result);
+    const bool ok = write(fds[1], result, sizeof(result)) == sizeof(result);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  std::size_t got = 0;
+  char* at = reinterpret_cast<char*>(ms);
+  for(ssize_t r; got < sizeof(double) * kAlgorithms &&
+                 (r = read(fds[0], at + got, sizeof(double) * kAlgorithms - got)) > 0; ) {
+    got += r;
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return got == sizeof(double) * kAlgorithms && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char** argv) {
+  const int hardware = std::max(1u, std::thread::hardware_concurrency());
+  const int maxThreads = argc > 1 ? std::atoi(argv[1]) : hardware;
+  const std::size_t n = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8000000;
+  if(maxThreads < 1 || n < 1) {
+    std::cerr << "usage: parallelBench [max threads] [elements]" << endl;
+    return 1;
+  }
+  cout << hardware << " hardware threads, " << n << " elements" << endl;
+  cout << "Milliseconds (speedup over 1 thread):" << endl;
+  cout << "threads";
+  for(const char* name : kNames) cout << std::setw(17) << name;
+  cout << endl;
+
+  double base[kAlgorithms];
+  for(int threads = 1; threads <= maxThreads; ++threads) {
+    double ms[kAlgorithms];
+    if(!measureWith(threads, n, ms)) {
+      std::cerr << "measuring with " << threads << " threads failed" << endl;
+      return 1;
+    }
+    if(threads == 1) std::copy(ms, ms + kAlgorithms, base);
+    cout << std::setw(7) << threads << std::fixed;
+    for(int a = 0; a < kAlgorithms; ++a) {
+      cout << std::setw(10) << std::setprecision(2) << ms[a]
+           << " (" << std::setw(4) << std::setprecision(2) << base[a] / ms[a] << ")";
+    }
+    cout << endl;
+  }
+  return 0;
+}
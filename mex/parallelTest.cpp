@@ -0,0 +1,194 @@
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <cassert>
+
+#include "parallel.h"
+#include "std_oversights.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::begin;
+using std::end;
+using std::plus;
+using std::less;
+using std::int32_t;
+using std::int64_t;
+
+using mex::data;
+using mex::not_fn;
+using mex::par::ThreadPool;
+
+namespace par = mex::par;
+
+int main(int argc, char** argv) {
+  //Make sure the pool has workers even on a single core machine.
+  setenv("MEX_PAR_THREADS", "4", 0);
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+vector<int> randomInts(std::size_t n, int maxValue) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(0, maxValue);
+  vector<int> result(n);
+  for(auto& x : result) x = dist(gen);
+  return result;
+}
+
+bool isOdd(int x) { return x % 2 != 0; }
+
+MEX_UNIT_TEST
+  ThreadPool pool(3);
+  assert(pool.size() == 3);
+  vector<std::atomic<int>> hits(1000);
+  for(auto& h : hits) h.store(0);
+  pool.forkJoin(hits.size(), [&](std::size_t i) { ++hits[i]; });
+  for(auto& h : hits) assert(h.load() == 1);
+
+  //Nested calls and exceptions.
+  std::atomic<int> inner(0);
+  pool.forkJoin(8, [&](std::size_t) {
+    pool.forkJoin(8, [&](std::size_t) { ++inner; });
+  });
+  assert(inner.load() == 64);
+  unittest::expect_exception<std::runtime_error>([&]() {
+    pool.forkJoin(50, [](std::size_t i) {
+      if(i == 17) throw std::runtime_error("task failed");
+    });
+  });
+
+  //A pool of one runs the tasks itself, but still runs all of them.
+  ThreadPool serial(1);
+  int ran = 0;
+  unittest::expect_exception<std::runtime_error>([&]() {
+    serial.forkJoin(10, [&ran](std::size_t i) {
+      ++ran;
+      if(i == 3 || i == 5) throw std::runtime_error("task failed");
+    });
+  });
+  assert(ran == 10);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  assert(ThreadPool::global().size() == 4);
+  const auto in = randomInts(100000, 1000);
+  vector<int> out(in.size());
+  par::transform(in.begin(), in.end(), out.begin(),
+                 [](int x) { return x * 2 + 1; }, 1000);
+  for(std::size_t i = 0; i < in.size(); ++i) assert(out[i] == in[i] * 2 + 1);
+
+  assert(par::count_if(in.begin(), in.end(), isOdd, 1000) ==
+         std::count_if(in.begin(), in.end(), isOdd));
+  assert(par::count_if(in.begin(), in.begin(), isOdd) == 0);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Generic and vectorised reductions agree with the serial ones.
+  const auto ints = randomInts(100003, 1000);
+  const int64_t serial = std::accumulate(ints.begin(), ints.end(), int64_t(0));
+  assert(par::reduce(ints.begin(), ints.end(), int64_t(0), plus<int64_t>(), 1000) == serial);
+  assert(par::reduce(data(ints), data(ints) + ints.size(), 0, plus<int>(), 1000) == serial);
+  assert(par::reduce(data(ints), data(ints) + ints.size(), 0) == serial);
+
+  vector<int64_t> longs(ints.begin(), ints.end());
+  assert(par::reduce(data(longs), data(longs) + longs.size(), int64_t(0),
+                     plus<int64_t>(), 777) == serial);
+
+  vector<double> doubles(ints.begin(), ints.end());
+  const double dsum = par::reduce(data(doubles), data(doubles) + doubles.size(), 0.0);
+  assert(std::fabs(dsum - serial) < 1e-6);
+
+  vector<float> floats(1000, 0.5f);
+  assert(par::reduce(data(floats), data(floats) + floats.size(), 0.0f,
+                     plus<float>(), 100) == 500.0f);
+
+  //The partial sums are kept in init's type, not the narrower element type.
+  vector<int> big(1 << 20, 8000);
+  assert(par::reduce(big.begin(), big.end(), 0LL, plus<long long>(), 1 << 19) ==
+         8000LL << 20);
+  assert(par::reduce(data(big), data(big) + big.size(), 0LL, plus<long long>(),
+                     1 << 19) == 8000LL << 20);
+
+  vector<string> words { "a", "b", "c", "d", "e" };
+  assert(par::reduce(words.begin(), words.end(), string(), plus<string>(), 1) == "abcde");
+  for(std::size_t n = 0; n < 40; ++n) {
+    assert(par::reduce(data(ints), data(ints) + n, 0, plus<int>(), 3) ==
+           std::accumulate(ints.begin(), ints.begin() + n, 0));
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  string haystack(100000, 'a');
+  const char* first = haystack.data();
+  const char* last = first + haystack.size();
+  assert(par::find(first, last, 'z', 1000) == last);
+  haystack[70001] = 'z';
+  haystack[99999] = 'z';
+  assert(par::find(first, last, 'z', 1000) == first + 70001);
+  haystack[3] = 'z';
+  assert(par::find(first, last, 'z', 1000) == first + 3);
+  for(std::size_t i = 0; i < 40; ++i) {
+    string small(40, 'a');
+    small[i] = 'q';
+    assert(par::find(&small[0], &small[0] + small.size(), 'q') == &small[0] + i);
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  for(std::size_t grain : { std::size_t(0), std::size_t(1), std::size_t(7), std::size_t(1000) }) {
+    auto v = randomInts(20011, 100);
+    const auto expectedTrues = std::count_if(v.begin(), v.end(), isOdd);
+    auto mid = par::partition(v.begin(), v.end(), isOdd, grain);
+    assert(mid - v.begin() == expectedTrues);
+    assert(std::all_of(v.begin(), mid, isOdd));
+    assert(std::none_of(mid, v.end(), isOdd));
+
+    mid = par::partition(v.begin(), v.end(), not_fn(isOdd), grain);
+    assert(v.end() - mid == expectedTrues);
+    assert(std::none_of(v.begin(), mid, isOdd));
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  for(std::size_t grain : { std::size_t(0), std::size_t(3), std::size_t(1000), std::size_t(4096) }) {
+    auto v = randomInts(50001, 1000000);
+    auto expected = v;
+    std::sort(expected.begin(), expected.end());
+    par::sort(v.begin(), v.end(), less<int>(), grain);
+    assert(v == expected);
+  }
+
+  //Stable, and works on move-only types.
+  vector<std::pair<int, int>> pairs;
+  const auto keys = randomInts(30000, 50);
+  for(std::size_t i = 0; i < keys.size(); ++i) pairs.emplace_back(keys[i], int(i));
+  auto stable = pairs;
+  auto byKey = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+    return a.first < b.first;
+  };
+  std::stable_sort(stable.begin(), stable.end(), byKey);
+  par::sort(pairs.begin(), pairs.end(), byKey, 1000);
+  assert(pairs == stable);
+
+  vector<std::unique_ptr<int>> owners;
+  for(int x : randomInts(5000, 100)) owners.push_back(mex::make_unique<int>(x));
+  par::sort(owners.begin(), owners.end(),
+    [](const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) { return *a < *b; }, 100);
+  assert(std::is_sorted(owners.begin(), owners.end(),
+    [](const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) { return *a < *b; }));
+MEX_END_UNIT_TEST
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <type_traits>
+
+#include "std_oversights.h"
+
+/*
+ *********************************OVERVIEW*************************************
+ * Bounded queues for passing values (typically Expected<TYPE>s) between the
+ * threads of a pipeline:
+ *    * SpscRing<T>: exactly one producer thread and one consumer thread. The
+ *      cheapest option; supports batch push/pop that publish once per batch.
+ *    * MpmcQueue<T>: any number of producers and consumers. Dmitry Vyukov's
+ *      bounded queue: each cell carries a sequence number that tells
+ *      producers and consumers whose turn it is, so an operation costs a
+ *      single CAS on the shared position in the uncontended case.
+ *
+ * In both, the indices written by different sides live on different cache
+ * lines. SpscRing additionally keeps a cached copy of the other side's index
+ * so that while the ring is neither full nor empty an operation touches no
+ * cache line the other thread writes.
+ *
+ * T only needs to be move constructible and move assignable; move-only
+ * payloads such as Expected<std::unique_ptr<X>> are fine. Popping move assigns
+ * into the caller's object. If constructing a pushed value throws, nothing is
+ * pushed; if the move assignment of a popped one throws, that value is lost.
+ * Either way the queue stays usable.
+ *
+ * Non-blocking operations (tryPush/tryPop and friends) report failure via
+ * their return value. The blocking push/pop spin briefly and then yield until
+ * they succeed - nothing else wakes them, so have the producer send a sentinel
+ * (an Expected holding an exception works nicely) to shut a consumer down.
+ *
+ ********************************EXAMPLE***************************************
+ *
+   mex::SpscRing<Expected<int>> ring(1024);
+   std::thread consumer([&] {
+     Expected<int> result = 0;
+     for(ring.pop(result); result.valid(); ring.pop(result)) use(result.get());
+   });
+   for(const auto& s : inputs) ring.push(parseInt(s));
+   ring.push(std::runtime_error("done"));
+   consumer.join();
+ */
+
+namespace mex {
+
+namespace detail {
+  //Used by the blocking variants: spin a little, since the other side is
+  //usually just about to act, then back off to the scheduler.
+  class SpinBackoff {
+  public:
+    void pause() {
+      if(spins_ < kSpinLimit) ++spins_;
+      else std::this_thread::yield();
+    }
+  private:
+    static constexpr int kSpinLimit = 64;
+    int spins_ = 0;
+  };
+
+  inline std::size_t roundUpToPowerOfTwo(std::size_t n) {
+    std::size_t result = 2;
+    while(result < n) result <<= 1;
+    return result;
+  }
+} //namespace detail
+
+template<typename T>
+class SpscRing {
+public:
+  //Capacity is rounded up to a power of two (minimum 2).
+  explicit SpscRing(std::size_t capacity);
+  ~SpscRing();
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  //Producer side.
+  bool tryPush(const T& value);
+  bool tryPush(T&& value);
+  template<typename... Args>
+  bool tryEmplace(Args&&... args);
+  void push(T value); //Blocks while full.
+
+  //Moves elements out of [first, last) until the ring is full. Returns the
+  //first element not pushed. The tail is published once for the whole batch.
+  template<typename InputIt>
+  InputIt tryPushBatch(InputIt first, InputIt last);
+
+  //Consumer side.
+  bool tryPop(T& out);
+  void pop(T& out); //Blocks while empty.
+
+  //Move assigns up to 'max' elements through 'out'. Returns the number popped.
+  //The head is published once for the whole batch.
+  template<typename OutputIt>
+  std::size_t tryPopBatch(OutputIt out, std::size_t max);
+
+  //Either side. Approximate while the other side is active.
+  std::size_t size() const;
+  bool empty() const { return size() == 0; }
+  std::size_t capacity() const { return mask_ + 1; }
+
+private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  T* slot(std::size_t index) {
+    return reinterpret_cast<T*>(&buffer_[index & mask_]);
+  }
+
+  static constexpr std::size_t kPad = hardware_destructive_interference_size;
+
+  const std::size_t mask_;
+  const std::unique_ptr<Storage[]> buffer_;
+
+  alignas(kPad) std::atomic<std::size_t> head_; //Written by the consumer.
+  std::size_t cachedTail_;                      //Consumer's view of tail_.
+
+  alignas(kPad) std::atomic<std::size_t> tail_; //Written by the producer.
+  std::size_t cachedHead_;                      //Producer's view of head_.
+};
+
+
+
+template<typename T>
+class MpmcQueue {
+public:
+  //Capacity is rounded up to a power of two (minimum 2).
+  explicit MpmcQueue(std::size_t capacity);
+  ~MpmcQueue();
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  bool tryPush(const T& value);
+  bool tryPush(T&& value);
+  template<typename... Args>
+  bool tryEmplace(Args&&... args);
+  void push(T value); //Blocks while full.
+
+  bool tryPop(T& out);
+  void pop(T& out); //Blocks while empty.
+
+  //Approximate while other threads are active.
+  std::size_t size() const;
+  bool empty() const { return size() == 0; }
+  std::size_t capacity() const { return mask_ + 1; }
+
+private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  //A cell at position pos is free for the producer claiming pos when
+  //sequence == pos, and full for the consumer claiming pos when
+  //sequence == pos + 1.
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    bool full; //False if constructing the value threw; consumers skip it.
+    Storage storage;
+
+    T* value() { return reinterpret_cast<T*>(&storage); }
+  };
+
+  static constexpr std::size_t kPad = hardware_destructive_interference_size;
+
+  const std::size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+
+  alignas(kPad) std::atomic<std::size_t> enqueuePos_;
+  alignas(kPad) std::atomic<std::size_t> dequeuePos_;
+};
+
+
+/******************************************************************************
+ ******************************************************************************
+ *******************************INLINE FUNCTIONS*******************************
+ ******************************************************************************
+ *****************************************************************************/
+
+template<typename T>
+constexpr std::size_t SpscRing<T>::kPad;
+
+template<typename T>
+SpscRing<T>::SpscRing(std::size_t capacity)
+  : mask_(detail::roundUpToPowerOfTwo(capacity) - 1),
+    buffer_(new Storage[mask_ + 1]),
+    head_(0), cachedTail_(0), tail_(0), cachedHead_(0) {}
+
+template<typename T>
+SpscRing<T>::~SpscRing() {
+  const auto tail = tail_.load(std::memory_order_relaxed);
+  for(auto i = head_.load(std::memory_order_relaxed); i != tail; ++i) {
+    slot(i)->~T();
+  }
+}
+
+template<typename T>
+template<typename... Args>
+bool SpscRing<T>::tryEmplace(Args&&... args) {
+  const auto tail = tail_.load(std::memory_order_relaxed);
+  if(tail - cachedHead_ > mask_) {
+    cachedHead_ = head_.load(std::memory_order_acquire);
+    if(tail - cachedHead_ > mask_) return false;
+  }
+  new(slot(tail)) T(std::forward<Args>(args)...);
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T>
+bool SpscRing<T>::tryPush(const T& value) {
+  return tryEmplace(value);
+}
+
+template<typename T>
+bool SpscRing<T>::tryPush(T&& value) {
+  return tryEmplace(std::move(value));
+}
+
+template<typename T>
+void SpscRing<T>::push(T value) {
+  detail::SpinBackoff backoff;
+  while(!tryEmplace(std::move(value))) backoff.pause();
+}
+
+template<typename T>
+template<typename InputIt>
+InputIt SpscRing<T>::tryPushBatch(InputIt first, InputIt last) {
+  auto tail = tail_.load(std::memory_order_relaxed);
+  if(first == last) return first;
+  if(tail - cachedHead_ > mask_) {
+    cachedHead_ = head_.load(std::memory_order_acquire);
+  }
+  for(; first != last && tail - cachedHead_ <= mask_; ++first, ++tail) {
+    new(slot(tail)) T(std::move(*first));
+  }
+  tail_.store(tail, std::memory_order_release);
+  return first;
+}
+
+template<typename T>
+bool SpscRing<T>::tryPop(T& out) {
+  const auto head = head_.load(std::memory_order_relaxed);
+  if(head == cachedTail_) {
+    cachedTail_ = tail_.load(std::memory_order_acquire);
+    if(head == cachedTail_) return false;
+  }
+  T* value = slot(head);
+  out = std::move(*value);
+  value->~T();
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename T>
+void SpscRing<T>::pop(T& out) {
+  detail::SpinBackoff backoff;
+  while(!tryPop(out)) backoff.pause();
+}
+
+template<typename T>
+template<typename OutputIt>
+std::size_t SpscRing<T>::tryPopBatch(OutputIt out, std::size_t max) {
+  auto head = head_.load(std::memory_order_relaxed);
+  if(cachedTail_ - head < max) {
+    cachedTail_ = tail_.load(std::memory_order_acquire);
+  }
+  std::size_t popped = 0;
+  for(; popped < max && head != cachedTail_; ++popped, ++head, ++out) {
+    T* value = slot(head);
+    *out = std::move(*value);
+    value->~T();
+  }
+  head_.store(head, std::memory_order_release);
+  return popped;
+}
+
+template<typename T>
+std::size_t SpscRing<T>::size() const {
+  const auto head = head_.load(std::memory_order_acquire);
+  const auto tail = tail_.load(std::memory_order_acquire);
+  return std::min(tail - head, mask_ + 1);
+}
+
+template<typename T>
+constexpr std::size_t MpmcQueue<T>::kPad;
+
+template<typename T>
+MpmcQueue<T>::MpmcQueue(std::size_t capacity)
+  : mask_(detail::roundUpToPowerOfTwo(capacity) - 1),
+    cells_(new Cell[mask_ + 1]),
+    enqueuePos_(0), dequeuePos_(0)
+{
+  for(std::size_t i = 0; i <= mask_; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template<typename T>
+MpmcQueue<T>::~MpmcQueue() {
+  const auto end = enqueuePos_.load(std::memory_order_relaxed);
+  for(auto i = dequeuePos_.load(std::memory_order_relaxed); i != end; ++i) {
+    if(cells_[i & mask_].full) cells_[i & mask_].value()->~T();
+  }
+}
+
+template<typename T>
+template<typename... Args>
+bool MpmcQueue<T>::tryEmplace(Args&&... args) {
+  auto pos = enqueuePos_.load(std::memory_order_relaxed);
+  Cell* cell;
+  for(;;) {
+    cell = &cells_[pos & mask_];
+    const auto sequence = cell->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+    if(diff == 0) {
+      if(enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) break;
+    } else if(diff < 0) {
+      return false; //Still holds the value from a lap ago: full.
+    } else {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+  //The cell is ours now, and must be handed on even if T's constructor
+  //throws, or every later consumer and producer would wait for it forever.
+  struct Publish {
+    Cell* cell;
+    std::size_t sequence;
+    ~Publish() { cell->sequence.store(sequence, std::memory_order_release); }
+  } publish{cell, pos + 1};
+  cell->full = false;
+  new(cell->value()) T(std::forward<Args>(args)...);
+  cell->full = true;
+  return true;
+}
+
+template<typename T>
+bool MpmcQueue<T>::tryPush(const T& value) {
+  return tryEmplace(value);
+}
+
+template<typename T>
+bool MpmcQueue<T>::tryPush(T&& value) {
+  return tryEmplace(std::move(value));
+}
+
+template<typename T>
+void MpmcQueue<T>::push(T value) {
+  detail::SpinBackoff backoff;
+  while(!tryEmplace(std::move(value))) backoff.pause();
+}
+
+template<typename T>
+bool MpmcQueue<T>::tryPop(T& out) {
+  auto pos = dequeuePos_.load(std::memory_order_relaxed);
+  Cell* cell;
+  for(;;) {
+    cell = &cells_[pos & mask_];
+    const auto sequence = cell->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+    if(diff == 0) {
+      if(dequeuePos_.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+        if(cell->full) break;
+        //A push whose value failed to construct: recycle the cell, go on.
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    } else if(diff < 0) {
+      return false; //Not yet written this lap: empty.
+    } else {
+      pos = dequeuePos_.load(std::memory_order_relaxed);
+    }
+  }
+  //Recycle the cell even if the assignment throws, as in tryEmplace.
+  struct Release {
+    Cell* cell;
+    std::size_t sequence;
+    ~Release() {
+      cell->value()->~T();
+      cell->sequence.store(sequence, std::memory_order_release);
+    }
+  } release{cell, pos + mask_ + 1};
+  out = std::move(*cell->value());
+  return true;
+}
+
+template<typename T>
+void MpmcQueue<T>::pop(T& out) {
+  detail::SpinBackoff backoff;
+  while(!tryPop(out)) backoff.pause();
+}
+
+template<typename T>
+std::size_t MpmcQueue<T>::size() const {
+  const auto head = dequeuePos_.load(std::memory_order_acquire);
+  const auto tail = enqueuePos_.load(std::memory_order_acquire);
+  const auto diff = static_cast<std::ptrdiff_t>(tail - head);
+  return diff <= 0 ? 0 : std::min(static_cast<std::size_t>(diff), mask_ + 1);
+}
+
+} //namespace mex
@@ -0,0 +1,153 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+#include "Expected.h"
+#include "queues.h"
+
+/*
+ * Throughput and latency of SpscRing and MpmcQueue against a mutex and
+ * condition variable guarded std::deque, passing Expected<int>s:
+ *    * throughput: items per second from P producers to C consumers.
+ *    * latency: round trips per second between two threads bouncing one item
+ *      through a pair of queues.
+ *
+ * Usage: queuesBench [items (default 2000000)]
+ * Build with optimizations; the spinning queues need a core per thread to
+ * show their worth.
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::thread;
+
+using mex::Expected;
+using mex::SpscRing;
+using mex::MpmcQueue;
+
+//The baseline: bounded, blocking, as a straightforward implementation would be.
+template<typename T>
+class LockedQueue {
+public:
+  explicit LockedQueue(std::size_t capacity) : capacity_(capacity) {}
+
+  void push(T value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this]() { return items_.size() < capacity_; });
+    items_.push_back(std::move(value));
+    lock.unlock();
+    notEmpty_.notify_one();
+  }
+
+  void pop(T& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this]() { return !items_.empty(); });
+    out = std::move(items_.front());
+    items_.pop_front();
+    lock.unlock();
+    notFull_.notify_one();
+  }
+
+private:
+  const std::size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::deque<T> items_;
+};
+
+const std::size_t kCapacity = 1024;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const string& name, double perSecond, const char* unit) {
+  cout << "  " << std::left << std::setw(22) << name << std::right
+       << std::setw(10) << std::fixed << std::setprecision(2)
+       << perSecond / 1e6 << " M " << unit << "/s" << endl;
+}
+
+//items is split evenly over the producers and over the consumers.
+template<typename QUEUE>
+double throughput(std::size_t items, int producers, int consumers) {
+  QUEUE queue(kCapacity);
+  const auto start = std::chrono::steady_clock::now();
+  vector<thread> threads;
+  for(int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, items, producers]() {
+      for(std::size_t i = 0; i < items / producers; ++i) {
+        queue.push(Expected<int>(static_cast<int>(i)));
+      }
+    });
+  }
+  for(int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&queue, items, consumers]() {
+      Expected<int> out = 0;
+      for(std::size_t i = 0; i < items / consumers; ++i) queue.pop(out);
+    });
+  }
+  for(auto& t : threads) t.join();
+  return items / secondsSince(start);
+}
+
+template<typename QUEUE>
+double roundTrips(std::size_t trips) {
+  QUEUE there(kCapacity);
+  QUEUE back(kCapacity);
+  const auto start = std::chrono::steady_clock::now();
+  thread echo([&]() {
+    Expected<int> value = 0;
+    for(std::size_t i = 0; i < trips; ++i) {
+      there.pop(value);
+      back.push(std::move(value));
+    }
+  });
+  Expected<int> value = 0;
+  for(std::size_t i = 0; i < trips; ++i) {
+    there.push(Expected<int>(static_cast<int>(i)));
+    back.pop(value);
+  }
+  echo.join();
+  return trips / secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+  const std::size_t items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  //Divisible by every producer and consumer count below.
+  const std::size_t even = items / 12 * 12;
+  cout << thread::hardware_concurrency() << " hardware threads, "
+       << even << " items, capacity " << kCapacity << endl;
+
+  using Spsc = SpscRing<Expected<int>>;
+  using Mpmc = MpmcQueue<Expected<int>>;
+  using Locked = LockedQueue<Expected<int>>;
+
+  cout << "Throughput, 1 producer 1 consumer:" << endl;
+  report("SpscRing", throughput<Spsc>(even, 1, 1), "items");
+  report("MpmcQueue", throughput<Mpmc>(even, 1, 1), "items");
+  report("mutex+deque", throughput<Locked>(even, 1, 1), "items");
+
+  for(int threads : { 2, 4 }) {
+    cout << "Throughput, " << threads << " producers " << threads << " consumers:" << endl;
+    report("MpmcQueue", throughput<Mpmc>(even, threads, threads), "items");
+    report("mutex+deque", throughput<Locked>(even, threads, threads), "items");
+  }
+
+  const std::size_t trips = even / 20;
+  cout << "Latency, round trips between two threads:" << endl;
+  report("SpscRing", roundTrips<Spsc>(trips), "trips");
+  report("MpmcQueue", roundTrips<Mpmc>(trips), "trips");
+  report("mutex+deque", roundTrips<Locked>(trips), "trips");
+  return 0;
+}
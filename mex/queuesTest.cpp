@@ -0,0 +1,252 @@
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <numeric>
+#include <stdexcept>
+#include <cassert>
+
+#include "Expected.h"
+#include "queues.h"
+#include "std_oversights.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::thread;
+using std::unique_ptr;
+using std::begin;
+using std::end;
+
+using mex::Expected;
+using mex::SpscRing;
+using mex::MpmcQueue;
+using mex::make_unique;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+//Counts live instances so we can check the queues destroy what they hold.
+struct Tracked {
+  static int live;
+  int value;
+  Tracked(int v = 0) : value(v) { ++live; }
+  Tracked(const Tracked& rhs) : value(rhs.value) { ++live; }
+  Tracked& operator=(const Tracked&) = default;
+  ~Tracked() { --live; }
+};
+int Tracked::live = 0;
+
+//Throws when built from a negative value, or when assigned to while armed.
+struct Fragile {
+  static bool throwOnAssign;
+  int value;
+  Fragile(int v = 0) : value(v) {
+    if(v < 0) throw std::invalid_argument("negative");
+  }
+  Fragile(Fragile&& rhs) : value(rhs.value) {}
+  Fragile& operator=(Fragile&& rhs) {
+    if(throwOnAssign) throw std::runtime_error("assignment failed");
+    value = rhs.value;
+    return *this;
+  }
+};
+bool Fragile::throwOnAssign = false;
+
+MEX_UNIT_TEST
+  SpscRing<int> ring(5);
+  assert(ring.capacity() == 8);
+  assert(ring.empty());
+
+  for(int i = 0; i < 8; ++i) assert(ring.tryPush(i));
+  assert(!ring.tryPush(8));
+  assert(ring.size() == 8);
+
+  int out = -1;
+  for(int i = 0; i < 8; ++i) {
+    assert(ring.tryPop(out));
+    assert(out == i);
+  }
+  assert(!ring.tryPop(out));
+  assert(ring.empty());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  SpscRing<int> ring(8);
+  vector<int> in(12);
+  std::iota(begin(in), end(in), 0);
+
+  auto rest = ring.tryPushBatch(begin(in), end(in));
+  assert(rest - begin(in) == 8);
+  assert(ring.tryPushBatch(rest, end(in)) == rest);
+
+  vector<int> out(5);
+  assert(ring.tryPopBatch(begin(out), out.size()) == 5);
+  assert(std::equal(begin(out), end(out), begin(in)));
+
+  rest = ring.tryPushBatch(rest, end(in));
+  assert(rest == end(in));
+
+  out.assign(20, -1);
+  assert(ring.tryPopBatch(begin(out), out.size()) == 7);
+  assert(std::equal(begin(out), begin(out) + 7, begin(in) + 5));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  {
+    SpscRing<Tracked> ring(4);
+    MpmcQueue<Tracked> queue(4);
+    for(int i = 0; i < 3; ++i) {
+      ring.tryEmplace(i);
+      queue.tryEmplace(i);
+    }
+    Tracked out;
+    assert(ring.tryPop(out) && queue.tryPop(out));
+    assert(Tracked::live == 5);
+  }
+  assert(Tracked::live == 0);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Move-only payloads, valid and invalid, through both queues.
+  using Payload = Expected<unique_ptr<int>>;
+  SpscRing<Payload> ring(4);
+  MpmcQueue<Payload> queue(4);
+
+  assert(ring.tryPush(Payload(make_unique<int>(7))));
+  assert(ring.tryPush(Payload(std::runtime_error("bad"))));
+  assert(queue.tryPush(Payload(make_unique<int>(9))));
+  assert(queue.tryPush(Payload(std::runtime_error("bad"))));
+
+  Payload out(make_unique<int>(0));
+  assert(ring.tryPop(out) && out.valid() && *out.get() == 7);
+  assert(ring.tryPop(out) && out.hasException<std::runtime_error>());
+  assert(queue.tryPop(out) && out.valid() && *out.get() == 9);
+  assert(queue.tryPop(out) && out.hasException<std::runtime_error>());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  MpmcQueue<int> queue(3);
+  assert(queue.capacity() == 4);
+  for(int i = 0; i < 4; ++i) assert(queue.tryPush(i));
+  assert(!queue.tryPush(4));
+  assert(queue.size() == 4);
+
+  int out = -1;
+  for(int lap = 0; lap < 3; ++lap) {
+    for(int i = 0; i < 4; ++i) {
+      assert(queue.tryPop(out));
+      assert(out == lap * 4 + i);
+      assert(queue.tryPush(out + 4));
+    }
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //SPSC stress: blocking and batch operations, order must be preserved.
+  const int count = 50000;
+  SpscRing<Expected<int>> ring(64);
+
+  thread producer([&]() {
+    vector<Expected<int>> batch;
+    for(int i = 0; i < count; ) {
+      if(i % 3 == 0) {
+        ring.push(i++);
+        continue;
+      }
+      batch.clear();
+      for(int j = 0; j < 10 && i < count; ++j) batch.push_back(i++);
+      auto next = begin(batch);
+      while(next != end(batch)) next = ring.tryPushBatch(next, end(batch));
+    }
+    ring.push(std::runtime_error("done"));
+  });
+
+  int expected = 0;
+  Expected<int> item = -1;
+  vector<Expected<int>> batch(16, Expected<int>(-1));
+  for(bool done = false; !done; ) {
+    if(expected % 2 == 0) {
+      ring.pop(item);
+      if(!item.valid()) break;
+      assert(item.get() == expected++);
+      continue;
+    }
+    const auto popped = ring.tryPopBatch(begin(batch), batch.size());
+    for(std::size_t i = 0; i < popped; ++i) {
+      if(!batch[i].valid()) {
+        done = true;
+        break;
+      }
+      assert(batch[i].get() == expected++);
+    }
+  }
+  producer.join();
+  assert(expected == count);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //MPMC stress: every value delivered exactly once.
+  const int producers = 4;
+  const int consumers = 4;
+  const int perProducer = 10000;
+  MpmcQueue<int> queue(128);
+  vector<int> seen(producers * perProducer, 0);
+  vector<long long> sums(consumers, 0);
+
+  vector<thread> threads;
+  for(int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p]() {
+      for(int i = 0; i < perProducer; ++i) {
+        const int value = p * perProducer + i;
+        if(i % 2) queue.push(value);
+        else while(!queue.tryPush(value)) std::this_thread::yield();
+      }
+    });
+  }
+  for(int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&queue, &seen, &sums, c]() {
+      for(int i = 0; i < producers * perProducer / consumers; ++i) {
+        int value;
+        queue.pop(value);
+        ++seen[value]; //Each index is only ever written once if correct.
+        sums[c] += value;
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+
+  assert(queue.empty());
+  for(auto s : seen) assert(s == 1);
+  const long long n = producers * perProducer;
+  assert(std::accumulate(begin(sums), end(sums), 0LL) == n * (n - 1) / 2);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Throwing constructors and assignments leave the MPMC queue usable.
+  MpmcQueue<Fragile> queue(4);
+  assert(queue.tryEmplace(1));
+  unittest::expect_exception<std::invalid_argument>([&]() { queue.tryEmplace(-1); });
+  assert(queue.tryEmplace(2));
+  Fragile out;
+  assert(queue.tryPop(out) && out.value == 1);
+  assert(queue.tryPop(out) && out.value == 2); //Skips the failed push.
+  assert(!queue.tryPop(out));
+
+  queue.push(Fragile(3));
+  queue.push(Fragile(4));
+  Fragile::throwOnAssign = true;
+  unittest::expect_exception<std::runtime_error>([&]() { queue.tryPop(out); });
+  Fragile::throwOnAssign = false;
+  assert(queue.tryPop(out) && out.value == 4);
+  for(int lap = 0; lap < 3; ++lap) {
+    for(int i = 0; i < 4; ++i) assert(queue.tryPush(Fragile(i)));
+    assert(!queue.tryPush(Fragile(4)));
+    for(int i = 0; i < 4; ++i) assert(queue.tryPop(out) && out.value == i);
+  }
+MEX_END_UNIT_TEST
@@ -0,0 +1,163 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Expected.h"
+#include "ShmChannel.h"
+#include "wire.h"
+
+/*
+ * Streams results from a forked worker to its parent through a ShmChannel,
+ * a pipe and a Unix stream socket, and prints results per second. Over the
+ * pipe and the socket each result is encoded with mex::wire, written behind
+ * an 8 byte length with one write() per result, read back and decoded; the
+ * channel encodes and decodes in place. Every tenth result is an error.
+ *
+ * Usage: shmChannelBench [results (default 1000000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+
+using mex::Expected;
+using mex::ShmChannel;
+using mex::ChannelClosed;
+
+namespace wire = mex::wire;
+
+struct Sample {
+  std::int64_t index;
+  double value;
+};
+
+Expected<Sample> sampleOrError(std::int64_t i) {
+  if(i % 10 == 9) return std::out_of_range("sample " + std::to_string(i));
+  return Sample{i, i * 0.25};
+}
+
+void writeFully(int fd, const char* data, std::size_t size) {
+  while(size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if(written < 0 && errno == EINTR) continue;
+    if(written <= 0) _exit(1);
+    data += written;
+    size -= written;
+  }
+}
+
+//False on end of file before the first byte.
+bool readFully(int fd, char* data, std::size_t size) {
+  std::size_t got = 0;
+  while(got < size) {
+    const ssize_t r = read(fd, data + got, size - got);
+    if(r < 0 && errno == EINTR) continue;
+    if(r == 0 && got == 0) return false;
+    if(r <= 0) throw std::runtime_error("short read");
+    got += r;
+  }
+  return true;
+}
+
+//Forks a process running worker() while the parent runs run(), and returns
+//the seconds until the worker has exited.
+double timed(const std::function<void()>& worker, const std::function<void()>& run) {
+  const auto start = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+  if(pid == 0) {
+    worker();
+    _exit(0);
+  }
+  run();
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw std::runtime_error("worker failed");
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void check(std::int64_t received, std::int64_t count) {
+  if(received != count) throw std::runtime_error("lost results");
+}
+
+double viaChannel(std::int64_t count) {
+  ShmChannel<Sample> channel(1024);
+  std::int64_t received = 0;
+  const double seconds = timed([&]() {
+    channel.attachSender();
+    for(std::int64_t i = 0; i < count; ++i) channel.push(sampleOrError(i));
+    channel.closeSender();
+  }, [&]() {
+    for(auto r = channel.pop(); !r.hasException<ChannelClosed>(); r = channel.pop()) {
+      ++received;
+    }
+  });
+  check(received, count);
+  return seconds;
+}
+
+//fds[1] is the worker's end, fds[0] the parent's.
+double viaStream(int fds[2], std::int64_t count) {
+  std::int64_t received = 0;
+  const double seconds = timed([&]() {
+    close(fds[0]);
+    vector<char> buffer;
+    for(std::int64_t i = 0; i < count; ++i) {
+      buffer.assign(sizeof(std::uint64_t), 0);
+      wire::encode(sampleOrError(i), buffer);
+      const std::uint64_t length = buffer.size() - sizeof(length);
+      std::memcpy(buffer.data(), &length, sizeof(length));
+      writeFully(fds[1], buffer.data(), buffer.size());
+    }
+    close(fds[1]);
+  }, [&]() {
+    close(fds[1]);
+    vector<char> buffer;
+    std::uint64_t length;
+    while(readFully(fds[0], reinterpret_cast<char*>(&length), sizeof(length))) {
+      buffer.resize(length);
+      readFully(fds[0], buffer.data(), length);
+      wire::decode<Sample>(buffer.data(), length);
+      ++received;
+    }
+    close(fds[0]);
+  });
+  check(received, count);
+  return seconds;
+}
+
+void report(const string& name, std::int64_t count, double seconds) {
+  cout << "  " << std::left << std::setw(14) << name << std::right
+       << std::setw(10) << std::fixed << std::setprecision(2)
+       << count / seconds / 1e6 << " M results/s" << endl;
+}
+
+int main(int argc, char** argv) {
+  const std::int64_t count = argc > 1 ? std::atoll(argv[1]) : 1000000;
+  cout << count << " results of " << sizeof(Sample) << " bytes, 10% errors" << endl;
+
+  report("ShmChannel", count, viaChannel(count));
+
+  int fds[2];
+  if(pipe(fds) != 0) return 1;
+  report("pipe", count, viaStream(fds, count));
+
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return 1;
+  report("Unix socket", count, viaStream(fds, count));
+  return 0;
+}
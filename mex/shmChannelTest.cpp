@@ -0,0 +1,199 @@
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Expected.h"
+#include "ShmChannel.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::thread;
+
+using mex::Expected;
+using mex::ShmChannel;
+using mex::ChannelClosed;
+using mex::PeerDied;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+struct Sample {
+  std::int64_t index;
+  double value;
+};
+
+Expected<Sample> sampleOrError(std::int64_t i) {
+  if(i % 10 == 9) return std::out_of_range("sample " + std::to_string(i));
+  return Sample{i, i * 0.25};
+}
+
+void checkSample(const Expected<Sample>& result, std::int64_t i) {
+  if(i % 10 == 9) {
+    assert(result.hasException<std::out_of_range>());
+  } else {
+    assert(result.get().index == i && result.get().value == i * 0.25);
+  }
+}
+
+int waitForExit(pid_t pid) {
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return status;
+}
+
+MEX_UNIT_TEST
+  //Two threads of one process, through a tiny ring to exercise back-pressure.
+  ShmChannel<Sample> channel(4);
+  assert(channel.capacity() == 4);
+  const int count = 20000;
+  thread sender([&]() {
+    for(int i = 0; i < count; ++i) channel.push(sampleOrError(i));
+    channel.closeSender();
+  });
+  for(int i = 0; i < count; ++i) checkSample(channel.pop(), i);
+  assert(channel.pop().hasException<ChannelClosed>());
+  sender.join();
+
+  Expected<Sample> out = Sample{0, 0};
+  assert(channel.tryPop(out) && out.hasException<ChannelClosed>());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //A forked worker streams its results and closes.
+  ShmChannel<Sample> channel(64);
+  const int count = 5000;
+  const pid_t pid = fork();
+  if(pid == 0) {
+    channel.attachSender();
+    for(int i = 0; i < count; ++i) channel.push(sampleOrError(i));
+    channel.closeSender();
+    _exit(0);
+  }
+  for(int i = 0; i < count; ++i) checkSample(channel.pop(), i);
+  assert(channel.pop().hasException<ChannelClosed>());
+  assert(WIFEXITED(waitForExit(pid)));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //A worker crashing mid-stream: what it pushed arrives, then PeerDied. The
+  //child is reaped only afterwards, so the zombie must not pass for alive.
+  ShmChannel<Sample> channel(64);
+  const pid_t pid = fork();
+  if(pid == 0) {
+    channel.attachSender();
+    for(int i = 0; i < 5; ++i) channel.push(sampleOrError(i));
+    std::abort();
+  }
+  for(int i = 0; i < 5; ++i) checkSample(channel.pop(), i);
+  assert(channel.pop().hasException<PeerDied>());
+  assert(channel.pop().hasException<PeerDied>());
+  Expected<Sample> out = Sample{0, 0};
+  assert(channel.tryPop(out) && out.hasException<PeerDied>());
+  assert(WIFSIGNALED(waitForExit(pid)));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //The receiver dying makes a blocked sender throw instead of hanging.
+  ShmChannel<Sample> channel(2);
+  const pid_t pid = fork();
+  if(pid == 0) {
+    channel.attachReceiver();
+    channel.pop();
+    _exit(1); //Without closing: indistinguishable from a crash.
+  }
+  unittest::expect_exception<PeerDied>([&]() {
+    for(int i = 0; i < 1000; ++i) channel.push(sampleOrError(i));
+  });
+  //A polling sender learns of it too, rather than spinning on a full ring.
+  unittest::expect_exception<PeerDied>([&]() {
+    while(!channel.tryPush(sampleOrError(0))) {}
+  });
+  waitForExit(pid);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Named channels, long messages and mismatched openers.
+  const string name = "/mexShmChannelTest." + std::to_string(getpid());
+  auto created = ShmChannel<Sample>::createNamed(name, 8, 16);
+  auto opened = ShmChannel<Sample>::openNamed(name, 16);
+  ShmChannel<Sample>::unlinkNamed(name);
+
+  unittest::expect_exception<std::invalid_argument>([&]() {
+    ShmChannel<std::int32_t>::fromFd(dup(created.fd()), 16);
+  });
+  unittest::expect_exception<std::invalid_argument>([&]() {
+    ShmChannel<Sample>::fromFd(dup(created.fd()), 200);
+  });
+  unittest::expect_exception<std::system_error>([&]() {
+    ShmChannel<Sample>::openNamed(name, 16);
+  });
+
+  created.push(Sample{1, 2.0});
+  created.push(std::invalid_argument(string(100, 'x')));
+  assert(created.tryPush(Sample{3, 4.0}));
+
+  assert(opened.pop().get().index == 1);
+  const auto truncated = opened.pop();
+  try {
+    truncated.throwException();
+    assert(false);
+  } catch(const std::invalid_argument& e) {
+    const string message = e.what();
+    assert(message.size() >= 16 && message.size() < 100);
+    assert(message == string(message.size(), 'x'));
+  }
+  Expected<Sample> out = Sample{0, 0};
+  assert(opened.tryPop(out) && out.get().index == 3);
+  assert(!opened.tryPop(out));
+
+  unittest::expect_exception<std::logic_error>([&]() { opened.attachReceiver(); });
+  opened.closeReceiver();
+  unittest::expect_exception<ChannelClosed>([&]() { created.push(Sample{5, 6.0}); });
+  unittest::expect_exception<ChannelClosed>([&]() { created.tryPush(Sample{5, 6.0}); });
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //A corrupt slot is popped as a FormatError, and the records after it
+  //still arrive.
+  ShmChannel<Sample> channel(8);
+  const std::int64_t marker = 0x5EEDF00DCAFEll;
+  channel.push(Sample{marker, 1.0});
+  channel.push(Sample{2, 3.0});
+
+  struct stat info;
+  fstat(channel.fd(), &info);
+  void* mapped = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      channel.fd(), 0);
+  assert(mapped != MAP_FAILED);
+  char* bytes = static_cast<char*>(mapped);
+  char* found = nullptr;
+  for(off_t i = 8; i + 8 <= info.st_size && !found; i += 8) {
+    if(std::memcmp(bytes + i, &marker, sizeof(marker)) == 0) found = bytes + i;
+  }
+  assert(found);
+  const std::uint32_t badKind = 0xBAD;
+  std::memcpy(found - 8, &badKind, sizeof(badKind)); //The record header.
+  munmap(mapped, info.st_size);
+
+  assert(channel.pop().hasException<mex::wire::FormatError>());
+  assert(channel.pop().get().index == 2);
+  channel.push(Sample{4, 5.0});
+  Expected<Sample> out = Sample{0, 0};
+  assert(channel.tryPop(out) && out.get().index == 4);
+MEX_END_UNIT_TEST
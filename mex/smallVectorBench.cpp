@@ -0,0 +1,125 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#include "small_vector.h"
+
+/*
+ * small_vector<int, 8> against std::vector<int> on the workloads it is meant
+ * for, printing nanoseconds and heap allocations per operation:
+ *    * build: fill a fresh container with a handful of elements and sum it,
+ *      for sizes at, below and above the inline capacity.
+ *    * traverse: sum a large array of small containers, where inline storage
+ *      keeps each container's elements next to its size instead of behind a
+ *      pointer to a separate allocation. The containers are filled in random
+ *      order, as they would be in a long running program, so std::vector's
+ *      buffers are scattered over the heap rather than laid out in order.
+ *
+ * Usage: smallVectorBench [operations (default 2000000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+
+using mex::small_vector;
+
+//Every allocation in the program goes through these, so they can be counted.
+static std::uint64_t allocations = 0;
+
+void* operator new(std::size_t size) {
+  ++allocations;
+  if(void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+volatile std::int64_t sink = 0; //Keeps the results alive.
+
+struct Result {
+  double ns;
+  double allocations;
+};
+
+template<typename RUN>
+Result measure(std::size_t operations, RUN run) {
+  const std::uint64_t allocationsBefore = allocations;
+  const auto start = std::chrono::steady_clock::now();
+  run();
+  const std::chrono::duration<double, std::nano> took =
+    std::chrono::steady_clock::now() - start;
+  return Result{took.count() / operations,
+                double(allocations - allocationsBefore) / operations};
+}
+
+template<typename C>
+Result build(std::size_t operations, int size) {
+  return measure(operations, [&]() {
+    std::int64_t total = 0;
+    for(std::size_t op = 0; op < operations; ++op) {
+      C c;
+      for(int i = 0; i < size; ++i) c.push_back(int(op) + i);
+      for(int x : c) total += x;
+    }
+    sink += total;
+  });
+}
+
+template<typename C>
+Result traverse(std::size_t operations, int size) {
+  vector<C> all(operations / 16);
+  vector<std::size_t> order(all.size());
+  for(std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::shuffle(order.begin(), order.end(), std::mt19937(42));
+  for(std::size_t i : order) {
+    for(int j = 0; j < size; ++j) all[i].push_back(int(i) + j);
+  }
+  //16 passes over all of them, i.e. operations containers summed.
+  return measure(operations, [&]() {
+    std::int64_t total = 0;
+    for(int pass = 0; pass < 16; ++pass) {
+      for(const auto& c : all) {
+        for(int x : c) total += x;
+      }
+    }
+    sink += total;
+  });
+}
+
+void report(const string& name, Result small, Result standard) {
+  cout << "  " << std::left << std::setw(16) << name << std::right << std::fixed
+       << std::setprecision(1) << std::setw(9) << small.ns << " ns"
+       << std::setprecision(2) << std::setw(7) << small.allocations << " allocs"
+       << std::setprecision(1) << std::setw(11) << standard.ns << " ns"
+       << std::setprecision(2) << std::setw(7) << standard.allocations << " allocs"
+       << endl;
+}
+
+int main(int argc, char** argv) {
+  const std::size_t operations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  cout << operations << " operations, per operation:" << endl;
+  cout << std::setw(44) << "small_vector<int, 8>" << std::setw(26) << "std::vector<int>" << endl;
+  for(int size : { 2, 4, 8, 16 }) {
+    report("build " + std::to_string(size),
+           build<small_vector<int, 8>>(operations, size),
+           build<vector<int>>(operations, size));
+  }
+  for(int size : { 2, 4, 8 }) {
+    report("traverse " + std::to_string(size),
+           traverse<small_vector<int, 8>>(operations, size),
+           traverse<vector<int>>(operations, size));
+  }
+  return 0;
+}
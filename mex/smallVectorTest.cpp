@@ -0,0 +1,171 @@
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+#include "small_vector.h"
+#include "std_oversights.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::unique_ptr;
+using std::equal;
+
+using mex::small_vector;
+using mex::make_unique;
+using mex::operator"" _s;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+//Counts live instances and can be told to throw on the n-th copy.
+struct Tracked {
+  static int live;
+  static int copiesUntilThrow;
+  int value;
+  Tracked(int v = 0) : value(v) { ++live; }
+  Tracked(const Tracked& rhs) : value(rhs.value) {
+    if(copiesUntilThrow > 0 && --copiesUntilThrow == 0) {
+      throw std::runtime_error("copy failed");
+    }
+    ++live;
+  }
+  Tracked& operator=(const Tracked&) = default;
+  ~Tracked() { --live; }
+};
+int Tracked::live = 0;
+int Tracked::copiesUntilThrow = 0;
+
+MEX_UNIT_TEST
+  small_vector<int, 4> v;
+  assert(v.empty() && v.is_inline() && v.capacity() == 4);
+
+  for(int i = 0; i < 4; ++i) v.push_back(i);
+  assert(v.is_inline());
+  v.push_back(4);
+  assert(!v.is_inline());
+  assert(v.capacity() >= 5);
+  assert(v.size() == 5);
+  for(int i = 0; i < 5; ++i) assert(v[i] == i);
+
+  v.pop_back();
+  v.shrink_to_fit();
+  assert(v.is_inline());
+  assert(v.size() == 4 && v.back() == 3 && v.front() == 0);
+
+  unittest::expect_exception<std::out_of_range>([&]() { v.at(4); });
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Works with the std_oversights free functions.
+  small_vector<int, 8> v { 5, 3, 1 };
+  const auto& cv = v;
+  assert(mex::size(v) == 3);
+  assert(!mex::empty(v));
+  assert(mex::data(v) == &v[0]);
+  assert(mex::data(cv) == &v[0]);
+  assert(mex::cbegin(v) == v.data());
+  assert(mex::cend(v) == v.data() + 3);
+  std::sort(v.begin(), v.end());
+  assert((v == small_vector<int, 8>{ 1, 3, 5 }));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  small_vector<string, 2> v;
+  v.push_back("one"_s);
+  v.emplace_back(3, 'x');
+  v.push_back(v[0]); //Self-referencing push across the spill.
+  assert(!v.is_inline());
+  assert(v[0] == "one" && v[1] == "xxx" && v[2] == "one");
+  small_vector<int, 2> w { 1, 2, 3 };
+  w.resize(50, w[0]); //Self-referencing fill across a relocation.
+  assert(w.size() == 50 && std::count(w.begin(), w.end(), 1) == 48);
+
+  auto copy = v;
+  assert(copy == v);
+  auto moved = std::move(copy);
+  assert(copy.empty() && copy.is_inline());
+  assert(moved == v);
+
+  small_vector<string, 2> small { "a", "b" };
+  auto movedSmall = std::move(small);
+  assert(small.empty());
+  assert((movedSmall == small_vector<string, 2>{ "a", "b" }));
+
+  swap(moved, movedSmall);
+  assert(moved.size() == 2 && movedSmall.size() == 3);
+
+  movedSmall.erase(movedSmall.begin());
+  assert((movedSmall == small_vector<string, 2>{ "xxx", "one" }));
+  movedSmall.erase(movedSmall.begin(), movedSmall.end());
+  assert(movedSmall.empty());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  small_vector<unique_ptr<int>, 2> v;
+  for(int i = 0; i < 10; ++i) v.push_back(make_unique<int>(i));
+  for(int i = 0; i < 10; ++i) assert(*v[i] == i);
+  small_vector<unique_ptr<int>, 2> other;
+  other = std::move(v);
+  assert(v.empty() && other.size() == 10);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  {
+    small_vector<Tracked, 3> v(5, Tracked(7));
+    assert(Tracked::live == 5);
+    v.resize(2);
+    assert(Tracked::live == 2);
+    v.resize(6);
+    assert(Tracked::live == 6 && v[5].value == 0 && v[1].value == 7);
+    v.clear();
+    assert(Tracked::live == 0);
+    v = { Tracked(1), Tracked(2) };
+    assert(Tracked::live == 2);
+
+    //A throwing copy during growth leaves the vector untouched.
+    v.push_back(Tracked(3));
+    Tracked::copiesUntilThrow = 2;
+    unittest::expect_exception<std::runtime_error>([&]() { v.reserve(10); });
+    Tracked::copiesUntilThrow = 0;
+    assert(v.size() == 3 && v.capacity() == 3 && Tracked::live == 3);
+    assert(v[0].value == 1 && v[2].value == 3);
+
+    //Copies throwing at every point of range and copy construction, before
+    //and after the spill to the heap, leak and double free nothing.
+    v.push_back(Tracked(4));
+    v.push_back(Tracked(5));
+    for(int n = 1; n <= 12; ++n) {
+      Tracked::copiesUntilThrow = n;
+      try {
+        small_vector<Tracked, 3> copy(v);
+      } catch(const std::runtime_error&) {}
+      Tracked::copiesUntilThrow = n;
+      try {
+        small_vector<Tracked, 3> range(v.begin(), v.end());
+      } catch(const std::runtime_error&) {}
+      assert(Tracked::live == 5);
+    }
+    Tracked::copiesUntilThrow = 0;
+  }
+  assert(Tracked::live == 0);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  vector<int> source { 1, 2, 3, 4, 5, 6 };
+  small_vector<int, 4> fromRange(source.begin(), source.end());
+  assert(equal(source.begin(), source.end(), fromRange.begin()));
+  small_vector<int, 4> counted(3);
+  assert(counted.size() == 3 && counted[2] == 0);
+  assert((small_vector<int, 4>{ 1, 2 } < small_vector<int, 4>{ 1, 3 }));
+MEX_END_UNIT_TEST
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*
+ *********************************OVERVIEW*************************************
+ * small_vector<T, N> is a std::vector look-alike that keeps up to N elements
+ * inline (inside the object itself) and only allocates once it grows past N.
+ * Short-lived collections that are usually small then cost no allocation at
+ * all and their elements sit next to the rest of the object in cache.
+ *
+ * Iterators are plain pointers and the interface follows std::vector's
+ * (including data(), size(), empty(), cbegin() and cend()), so the free
+ * functions in std_oversights.h work on it unchanged:
+ *
+   mex::small_vector<int, 16> v { 1, 2, 3 };
+   v.push_back(4);
+   std::sort(v.begin(), v.end());
+   mex::size(v); mex::data(v); mex::cbegin(v);
+ *
+ * Differences from std::vector worth knowing:
+ * 1) Moving a small_vector whose elements are inline moves the elements one
+ *    by one (there is no buffer to steal), so it is O(size()) and, unlike
+ *    std::vector, invalidates iterators into the source.
+ * 2) Trivially copyable element types are relocated with memcpy when the
+ *    buffer grows, instead of being moved and destroyed one at a time.
+ * 3) Only the end-of-sequence modifiers are provided (push_back, emplace_back,
+ *    pop_back, resize, clear) along with erase. No allocator support.
+ */
+
+namespace mex {
+
+template<typename T, std::size_t N>
+class small_vector {
+  static_assert(N > 0, "use std::vector if you want no inline storage");
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "over-aligned types are not supported");
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  small_vector() noexcept : data_(inlineData()), size_(0), capacity_(N) {}
+  explicit small_vector(size_type count);
+  small_vector(size_type count, const T& value);
+  small_vector(std::initializer_list<T> il);
+  template<typename InputIt, typename = typename std::enable_if<
+    !std::is_integral<InputIt>::value>::type>
+  small_vector(InputIt first, InputIt last);
+
+  small_vector(const small_vector& rhs);
+  small_vector(small_vector&& rhs)
+    noexcept(std::is_nothrow_move_constructible<T>::value);
+  ~small_vector();
+
+  small_vector& operator=(const small_vector& rhs);
+  small_vector& operator=(small_vector&& rhs)
+    noexcept(std::is_nothrow_move_constructible<T>::value);
+  small_vector& operator=(std::initializer_list<T> il);
+
+  iterator begin() noexcept { return data_; }
+  const_iterator begin() const noexcept { return data_; }
+  const_iterator cbegin() const noexcept { return data_; }
+  iterator end() noexcept { return data_ + size_; }
+  const_iterator end() const noexcept { return data_ + size_; }
+  const_iterator cend() const noexcept { return data_ + size_; }
+  reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+  reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+  T* data() noexcept { return data_; }
+  const T* data() const noexcept { return data_; }
+  size_type size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+  size_type capacity() const noexcept { return capacity_; }
+  static constexpr size_type inline_capacity() noexcept { return N; }
+  bool is_inline() const noexcept { return data_ == inlineData(); }
+
+  T& operator[](size_type i) { return data_[i]; }
+  const T& operator[](size_type i) const { return data_[i]; }
+  T& at(size_type i);
+  const T& at(size_type i) const;
+  T& front() { return data_[0]; }
+  const T& front() const { return data_[0]; }
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+
+  void reserve(size_type newCapacity);
+  void shrink_to_fit(); //Moves back inline if the elements fit.
+  void clear() noexcept;
+  void resize(size_type count);
+  void resize(size_type count, const T& value);
+
+  void push_back(const T& value) { emplace_back(value); }
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+  template<typename... Args>
+  T& emplace_back(Args&&... args);
+  void pop_back();
+
+  iterator erase(const_iterator pos);
+  iterator erase(const_iterator first, const_iterator last);
+
+  void swap(small_vector& rhs);
+
+private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  T* inlineData() noexcept { return reinterpret_cast<T*>(inline_); }
+  const T* inlineData() const noexcept { return reinterpret_cast<const T*>(inline_); }
+
+  //Moves the elements to a buffer of newCapacity (>= size_) elements, which
+  //is the inline one if newCapacity == N.
+  void relocateTo(size_type newCapacity);
+  //Moves [first, last) to uninitialized memory at dest, destroying the source.
+  //If a move (or copy, for types that may throw on move) throws, the source
+  //is left untouched.
+  static void relocate(T* first, T* last, T* dest) {
+    relocate(first, last, dest, std::is_trivially_copyable<T>{});
+  }
+  static void relocate(T* first, T* last, T* dest, std::true_type);
+  static void relocate(T* first, T* last, T* dest, std::false_type);
+  //Leaves rhs empty and inline.
+  void takeFrom(small_vector& rhs);
+  void destroyAll() noexcept;
+  void deallocate() noexcept;
+  size_type grownCapacity(size_type minimum) const;
+
+  T* data_;
+  size_type size_;
+  size_type capacity_;
+  Storage inline_[N];
+};
+
+template<typename T, std::size_t N>
+bool operator==(const small_vector<T, N>& lhs, const small_vector<T, N>& rhs) {
+  return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename T, std::size_t N>
+bool operator!=(const small_vector<T, N>& lhs, const small_vector<T, N>& rhs) {
+  return !(lhs == rhs);
+}
+
+template<typename T, std::size_t N>
+bool operator<(const small_vector<T, N>& lhs, const small_vector<T, N>& rhs) {
+  return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+template<typename T, std::size_t N>
+void swap(small_vector<T, N>& lhs, small_vector<T, N>& rhs) {
+  lhs.swap(rhs);
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ *******************************INLINE FUNCTIONS*******************************
+ ******************************************************************************
+ *****************************************************************************/
+
+template<typename T, std::size_t N>
+small_vector<T, N>::small_vector(size_type count) : small_vector() {
+  resize(count);
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>::small_vector(size_type count, const T& value) : small_vector() {
+  resize(count, value);
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>::small_vector(std::initializer_list<T> il)
+  : small_vector(il.begin(), il.end()) {}
+
+template<typename T, std::size_t N>
+template<typename InputIt, typename>
+small_vector<T, N>::small_vector(InputIt first, InputIt last) : small_vector() {
+  //Delegating, so if a copy throws the destructor cleans up what was built.
+  for(; first != last; ++first) emplace_back(*first);
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>::small_vector(const small_vector& rhs)
+  : small_vector(rhs.begin(), rhs.end()) {}
+
+template<typename T, std::size_t N>
+small_vector<T, N>::small_vector(small_vector&& rhs)
+  noexcept(std::is_nothrow_move_constructible<T>::value)
+  : small_vector()
+{
+  takeFrom(rhs);
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>::~small_vector() {
+  destroyAll();
+  deallocate();
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>& small_vector<T, N>::operator=(const small_vector& rhs) {
+  if(this != &rhs) {
+    small_vector copy(rhs);
+    clear();
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>& small_vector<T, N>::operator=(small_vector&& rhs)
+  noexcept(std::is_nothrow_move_constructible<T>::value)
+{
+  if(this == &rhs) return *this;
+  destroyAll();
+  deallocate();
+  data_ = inlineData();
+  size_ = 0;
+  capacity_ = N;
+  takeFrom(rhs);
+  return *this;
+}
+
+template<typename T, std::size_t N>
+small_vector<T, N>& small_vector<T, N>::operator=(std::initializer_list<T> il) {
+  return *this = small_vector(il);
+}
+
+template<typename T, std::size_t N>
+T& small_vector<T, N>::at(size_type i) {
+  if(i >= size_) throw std::out_of_range("small_vector::at");
+  return data_[i];
+}
+
+template<typename T, std::size_t N>
+const T& small_vector<T, N>::at(size_type i) const {
+  if(i >= size_) throw std::out_of_range("small_vector::at");
+  return data_[i];
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::reserve(size_type newCapacity) {
+  if(newCapacity > capacity_) relocateTo(newCapacity);
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::shrink_to_fit() {
+  if(!is_inline() && size_ < capacity_) relocateTo(std::max(size_, N));
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::clear() noexcept {
+  destroyAll();
+  size_ = 0;
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::resize(size_type count) {
+  if(count > capacity_) relocateTo(grownCapacity(count));
+  while(size_ < count) emplace_back();
+  while(size_ > count) pop_back();
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::resize(size_type count, const T& value) {
+  if(count > capacity_) {
+    //Copy first: value may refer to an element we are about to relocate.
+    const T copy(value);
+    relocateTo(grownCapacity(count));
+    while(size_ < count) emplace_back(copy);
+  }
+  while(size_ < count) emplace_back(value);
+  while(size_ > count) pop_back();
+}
+
+template<typename T, std::size_t N>
+template<typename... Args>
+T& small_vector<T, N>::emplace_back(Args&&... args) {
+  if(size_ == capacity_) {
+    //Construct first: args may refer to an element we are about to relocate.
+    T value(std::forward<Args>(args)...);
+    relocateTo(grownCapacity(size_ + 1));
+    new(data_ + size_) T(std::move(value));
+  } else {
+    new(data_ + size_) T(std::forward<Args>(args)...);
+  }
+  return data_[size_++];
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::pop_back() {
+  data_[--size_].~T();
+}
+
+template<typename T, std::size_t N>
+typename small_vector<T, N>::iterator
+small_vector<T, N>::erase(const_iterator pos) {
+  return erase(pos, pos + 1);
+}
+
+template<typename T, std::size_t N>
+typename small_vector<T, N>::iterator
+small_vector<T, N>::erase(const_iterator first, const_iterator last) {
+  iterator dest = data_ + (first - data_);
+  iterator src = data_ + (last - data_);
+  if(dest != src) {
+    iterator newEnd = std::move(src, end(), dest);
+    while(end() != newEnd) pop_back();
+  }
+  return dest;
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::swap(small_vector& rhs) {
+  small_vector tmp(std::move(rhs));
+  rhs = std::move(*this);
+  *this = std::move(tmp);
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::takeFrom(small_vector& rhs) {
+  if(rhs.is_inline()) {
+    relocate(rhs.begin(), rhs.end(), data_);
+  } else {
+    data_ = rhs.data_;
+    capacity_ = rhs.capacity_;
+    rhs.data_ = rhs.inlineData();
+    rhs.capacity_ = N;
+  }
+  size_ = rhs.size_;
+  rhs.size_ = 0;
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::relocateTo(size_type newCapacity) {
+  const bool toInline = newCapacity == N;
+  T* newData = toInline
+    ? inlineData()
+    : static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+  try {
+    relocate(data_, data_ + size_, newData);
+  } catch(...) {
+    if(!toInline) ::operator delete(newData);
+    throw;
+  }
+  deallocate();
+  data_ = newData;
+  capacity_ = newCapacity;
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::relocate(T* first, T* last, T* dest, std::true_type) {
+  if(first != last) std::memcpy(dest, first, (last - first) * sizeof(T));
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::relocate(T* first, T* last, T* dest, std::false_type) {
+  T* constructed = dest;
+  try {
+    for(T* p = first; p != last; ++p, ++constructed) {
+      new(constructed) T(std::move_if_noexcept(*p));
+    }
+  } catch(...) {
+    while(constructed != dest) (--constructed)->~T();
+    throw;
+  }
+  for(; first != last; ++first) first->~T();
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::destroyAll() noexcept {
+  if(std::is_trivially_destructible<T>::value) return;
+  for(auto p = data_; p != data_ + size_; ++p) p->~T();
+}
+
+template<typename T, std::size_t N>
+void small_vector<T, N>::deallocate() noexcept {
+  if(!is_inline()) ::operator delete(data_);
+}
+
+template<typename T, std::size_t N>
+typename small_vector<T, N>::size_type
+small_vector<T, N>::grownCapacity(size_type minimum) const {
+  return std::max(minimum, capacity_ + capacity_ / 2 + 1);
+}
+
+} //namespace mex
@@ -49,6 +49,10 @@ constexpr T* data(T (&array)[N]) noexcept { return array; }
 template <class E>
 constexpr const E* data(std::initializer_list<E> il) noexcept { return begin(il); }
 
+//P0154: minimum offset between two objects to avoid false sharing. A fixed
+//guess, since we cannot ask the compiler; right for x86-64 and most ARM.
+constexpr std::size_t hardware_destructive_interference_size = 64;
+
 std::string operator"" _s (const char* cstr, std::size_t sz);
 
 template<typename T, typename... Args>
@@ -96,6 +100,11 @@ struct NotFnImpl {
   auto operator()(Args&&... args) -> decltype(!std::declval<typename std::result_of<FD(Args...)>::type>()) {
     return !fun_(std::forward<Args>(args)...);
   }
+
+  template<typename... Args>
+  auto operator()(Args&&... args) const -> decltype(!std::declval<typename std::result_of<const FD(Args...)>::type>()) {
+    return !fun_(std::forward<Args>(args)...);
+  }
 private:
   FD fun_;
 };
@@ -0,0 +1,321 @@
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+using std::atomic;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+using std::vector;
+using std::unique_ptr;
+using std::mutex;
+using std::lock_guard;
+using std::ostream;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace mex {
+namespace trace {
+
+namespace {
+
+  static_assert((kEventsPerThread & (kEventsPerThread - 1)) == 0,
+                "kEventsPerThread must be a power of two");
+
+  //Every field is a relaxed atomic so that a dump racing with the owning
+  //thread is well defined; on common hardware these compile to plain stores.
+  struct Slot {
+    atomic<uint64_t> timestampNs;
+    atomic<const char*> name;
+    atomic<const char*> detail;
+    atomic<const char*> file;
+    atomic<uint64_t> lineAndThread;
+  };
+
+  //Single writer (the leasing thread), any number of readers. Writers publish
+  //in seqlock fashion: 'claimed' is bumped before a slot is overwritten and
+  //'head' after, so a reader can tell which slots it may have seen torn.
+  struct ThreadBuffer {
+    Slot slots[kEventsPerThread];
+    atomic<uint64_t> claimed{0};
+    atomic<uint64_t> head{0};
+    atomic<uint64_t> floor{0}; //Events below this index were reset away.
+    uint32_t threadId = 0;
+    bool leased = false; //Guarded by registryMutex().
+  };
+
+  mutex& registryMutex() {
+    static mutex value;
+    return value;
+  }
+
+  //Buffers are never freed, only handed to a new thread once their previous
+  //owner exits, so events from short-lived threads survive until dumped and
+  //memory stays bounded by the peak number of concurrent threads.
+  vector<unique_ptr<ThreadBuffer>>& registry() {
+    static vector<unique_ptr<ThreadBuffer>> value;
+    return value;
+  }
+
+  uint32_t& nextThreadId() {
+    static uint32_t value = 1;
+    return value;
+  }
+
+  atomic<Counter*>& counterList() {
+    static atomic<Counter*> value{nullptr};
+    return value;
+  }
+
+  struct Lease {
+    ThreadBuffer* buffer = nullptr;
+
+    ~Lease() {
+      if(!buffer) return;
+      lock_guard<mutex> lock(registryMutex());
+      buffer->leased = false;
+    }
+  };
+
+  ThreadBuffer* leaseBuffer() {
+    lock_guard<mutex> lock(registryMutex());
+    ThreadBuffer* result = nullptr;
+    for(auto& candidate : registry()) {
+      if(!candidate->leased) {
+        result = candidate.get();
+        break;
+      }
+    }
+    if(!result) {
+      registry().emplace_back(new ThreadBuffer{});
+      result = registry().back().get();
+    }
+    result->leased = true;
+    result->threadId = nextThreadId()++;
+    return result;
+  }
+
+  ThreadBuffer& localBuffer() {
+    thread_local Lease lease;
+    if(!lease.buffer) lease.buffer = leaseBuffer();
+    return *lease.buffer;
+  }
+
+  uint64_t nowNs() {
+    using namespace std::chrono;
+    static const auto epoch = steady_clock::now();
+    return duration_cast<nanoseconds>(steady_clock::now() - epoch).count();
+  }
+
+  void snapshot(const ThreadBuffer& buffer, vector<Event>& out) {
+    const uint64_t end = buffer.head.load(memory_order_acquire);
+    const uint64_t oldest = end > kEventsPerThread ? end - kEventsPerThread : 0;
+    const uint64_t begin = std::max(oldest, buffer.floor.load(memory_order_relaxed));
+    const size_t firstOut = out.size();
+
+    for(uint64_t i = begin; i < end; ++i) {
+      const Slot& slot = buffer.slots[i & (kEventsPerThread - 1)];
+      const uint64_t lineAndThread = slot.lineAndThread.load(memory_order_relaxed);
+      out.push_back(Event{
+        slot.timestampNs.load(memory_order_relaxed),
+        slot.name.load(memory_order_relaxed),
+        slot.detail.load(memory_order_relaxed),
+        slot.file.load(memory_order_relaxed),
+        static_cast<uint32_t>(lineAndThread),
+        static_cast<uint32_t>(lineAndThread >> 32)
+      });
+    }
+
+    //Anything the writer started overwriting while we copied is suspect.
+    std::atomic_thread_fence(memory_order_acquire);
+    const uint64_t claimed = buffer.claimed.load(memory_order_relaxed);
+    const uint64_t valid = claimed > kEventsPerThread ? claimed - kEventsPerThread : 0;
+    if(valid > begin) {
+      const size_t torn = std::min<uint64_t>(valid - begin, out.size() - firstOut);
+      out.erase(out.begin() + firstOut, out.begin() + firstOut + torn);
+    }
+  }
+
+  void writeJsonString(ostream& out, const char* str) {
+    out << '"';
+    for(; *str; ++str) {
+      const unsigned char c = *str;
+      switch(c) {
+        case '"':  out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\t': out << "\\t"; break;
+        default:
+          if(c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << static_cast<int>(c) << std::dec << std::setfill(' ');
+          } else {
+            out << *str;
+          }
+      }
+    }
+    out << '"';
+  }
+
+  void writeMicroseconds(ostream& out, uint64_t ns) {
+    out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+        << std::setfill(' ');
+  }
+
+  template<typename T>
+  void writeRaw(ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void writeBinaryString(ostream& out, const char* str) {
+    if(!str) {
+      writeRaw<uint16_t>(out, 0xFFFF);
+      return;
+    }
+    const size_t length = std::min<size_t>(std::strlen(str), 0xFFFE);
+    writeRaw<uint16_t>(out, static_cast<uint16_t>(length));
+    out.write(str, length);
+  }
+
+} //namespace
+
+Counter::Counter(const char* name) : name_(name), value_(0), next_(nullptr) {
+  auto& list = counterList();
+  next_ = list.load(memory_order_relaxed);
+  while(!list.compare_exchange_weak(next_, this, memory_order_release,
+                                    memory_order_relaxed)) {}
+}
+
+void record(const char* name, const char* detail, const char* file, uint32_t line) {
+  ThreadBuffer& buffer = localBuffer();
+  const uint64_t index = buffer.head.load(memory_order_relaxed);
+  Slot& slot = buffer.slots[index & (kEventsPerThread - 1)];
+
+  buffer.claimed.store(index + 1, memory_order_relaxed);
+  std::atomic_thread_fence(memory_order_release);
+
+  slot.timestampNs.store(nowNs(), memory_order_relaxed);
+  slot.name.store(name, memory_order_relaxed);
+  slot.detail.store(detail, memory_order_relaxed);
+  slot.file.store(file, memory_order_relaxed);
+  slot.lineAndThread.store(static_cast<uint64_t>(buffer.threadId) << 32 | line,
+                           memory_order_relaxed);
+
+  buffer.head.store(index + 1, memory_order_release);
+}
+
+vector<Event> events() {
+  vector<Event> result;
+  {
+    lock_guard<mutex> lock(registryMutex());
+    for(const auto& buffer : registry()) snapshot(*buffer, result);
+  }
+  std::stable_sort(result.begin(), result.end(),
+    [](const Event& lhs, const Event& rhs) {
+      return lhs.timestampNs < rhs.timestampNs;
+    });
+  return result;
+}
+
+vector<CounterValue> counters() {
+  vector<CounterValue> result;
+  for(auto c = counterList().load(memory_order_acquire); c; c = c->next_) {
+    result.push_back(CounterValue{c->name_, c->value()});
+  }
+  return result;
+}
+
+void reset() {
+  {
+    lock_guard<mutex> lock(registryMutex());
+    for(auto& buffer : registry()) {
+      buffer->floor.store(buffer->head.load(memory_order_acquire),
+                          memory_order_relaxed);
+    }
+  }
+  for(auto c = counterList().load(memory_order_acquire); c; c = c->next_) {
+    c->value_.store(0, memory_order_relaxed);
+  }
+}
+
+void dumpChromeTrace(ostream& out) {
+  const auto allEvents = events();
+  const auto allCounters = counters();
+  const uint64_t now = nowNs();
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for(const auto& e : allEvents) {
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    first = false;
+    writeJsonString(out, e.name);
+    out << ",\"cat\":\"mex\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":"
+        << e.threadId << ",\"ts\":";
+    writeMicroseconds(out, e.timestampNs);
+    out << ",\"args\":{";
+    if(e.detail) {
+      out << "\"detail\":";
+      writeJsonString(out, e.detail);
+      out << ',';
+    }
+    if(e.file) {
+      out << "\"file\":";
+      writeJsonString(out, e.file);
+      out << ',';
+    }
+    out << "\"line\":" << e.line << "}}";
+  }
+  for(const auto& c : allCounters) {
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    first = false;
+    writeJsonString(out, c.name);
+    out << ",\"cat\":\"mex\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":";
+    writeMicroseconds(out, now);
+    out << ",\"args\":{\"value\":" << c.value << "}}";
+  }
+  out << "\n]}\n";
+}
+
+void dumpBinary(ostream& out) {
+  const auto allEvents = events();
+  const auto allCounters = counters();
+
+  out.write("MEXT", 4);
+  writeRaw<uint32_t>(out, 1);
+
+  writeRaw<uint32_t>(out, static_cast<uint32_t>(allCounters.size()));
+  for(const auto& c : allCounters) {
+    writeBinaryString(out, c.name);
+    writeRaw<uint64_t>(out, c.value);
+  }
+
+  writeRaw<uint64_t>(out, allEvents.size());
+  for(const auto& e : allEvents) {
+    writeRaw<uint64_t>(out, e.timestampNs);
+    writeRaw<uint32_t>(out, e.threadId);
+    writeRaw<uint32_t>(out, e.line);
+    writeBinaryString(out, e.name);
+    writeBinaryString(out, e.detail);
+    writeBinaryString(out, e.file);
+  }
+}
+
+namespace detail {
+  void recordExpectedError(const char* exceptionType,
+                           const char* file, uint32_t line) {
+    static Counter total{"mex.Expected.errors"};
+    total.increment();
+    record("Expected error", exceptionType, file, line);
+  }
+} //namespace detail
+
+} //namespace trace
+} //namespace mex
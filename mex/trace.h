@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <typeinfo>
+#include <vector>
+
+/*
+ *********************************OVERVIEW*************************************
+ * A low-overhead tracing facility meant to be left in hot paths of production
+ * code. It offers two primitives:
+ *    * Events: timestamped records written to a per-thread ring buffer. Only
+ *      the owning thread ever writes to its buffer, so recording an event is a
+ *      handful of relaxed stores and a release store of the write index - no
+ *      locks and no allocation. When the buffer is full the oldest events are
+ *      overwritten.
+ *    * Counters: named, statically registered std::atomic counters. Counting
+ *      an occurrence is a single relaxed fetch_add.
+ *
+ * Everything recorded can be dumped at any time (from any thread) either as
+ * Chrome's trace event JSON (load it in chrome://tracing or Perfetto) or as a
+ * compact binary format (described above dumpBinary).
+ *
+ * All strings handed to the facility (event names, details, counter names,
+ * files) MUST have static storage duration: only the pointers are stored.
+ * String literals, __FILE__ and typeid(...).name() are all fine.
+ *
+ *
+ ********************************EXAMPLE***************************************
+ * The macros are the intended interface, since they compile to nothing unless
+ * MEX_TRACE is defined:
+ *
+   void handleRequest(const Request& r) {
+     MEX_TRACE_COUNT("requests");
+     MEX_TRACE_EVENT("handleRequest", r.kindName());
+     ...
+   }
+ *
+ * Later, perhaps from a signal handler thread or an admin endpoint:
+ *
+   std::ofstream out("trace.json");
+   mex::trace::dumpChromeTrace(out);
+ *
+ * Defining MEX_TRACE_EXPECTED (which implies MEX_TRACE) makes every Expected
+ * constructed from an exception record an "Expected error" event carrying the
+ * exception type and the source location of the construction, and bump a
+ * per-exception-type counter. This relies on __builtin_FILE/__builtin_LINE
+ * (GCC and Clang).
+ *
+ * MEX_TRACE_EXPECTED changes the signatures of Expected's constructors, so it
+ * must be defined for the whole program - pass -DMEX_TRACE_EXPECTED to every
+ * compilation - never #defined in some translation units and not others:
+ * mixing the two is an ODR violation.
+ */
+
+#ifdef MEX_TRACE_EXPECTED
+#ifndef MEX_TRACE
+#define MEX_TRACE
+#endif
+#endif
+
+#ifdef MEX_TRACE
+
+#define MEX_TRACE_EVENT(NAME, DETAIL) \
+  ::mex::trace::record((NAME), (DETAIL), __FILE__, __LINE__)
+
+#define MEX_TRACE_COUNT(NAME)                           \
+  do {                                                  \
+    static ::mex::trace::Counter mexTraceCounter{NAME}; \
+    mexTraceCounter.increment();                        \
+  } while(0)
+
+#else
+
+#define MEX_TRACE_EVENT(NAME, DETAIL) ((void)0)
+#define MEX_TRACE_COUNT(NAME) ((void)0)
+
+#endif
+
+namespace mex {
+namespace trace {
+
+struct Event {
+  std::uint64_t timestampNs; //Since an arbitrary, process-wide, steady epoch.
+  const char* name;
+  const char* detail; //May be nullptr.
+  const char* file;   //May be nullptr.
+  std::uint32_t line;
+  std::uint32_t threadId; //Small integer assigned by the trace facility.
+};
+
+struct CounterValue {
+  const char* name;
+  std::uint64_t value;
+};
+
+//A named counter. Counters register themselves on construction and must
+//outlive any call to counters() or a dump function; in practice they should
+//be namespace-scope or function-local statics.
+class Counter {
+public:
+  explicit Counter(const char* name);
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  void increment(std::uint64_t by = 1) {
+    value_.fetch_add(by, std::memory_order_relaxed);
+  }
+  std::uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+  const char* name() const { return name_; }
+
+private:
+  friend std::vector<CounterValue> counters();
+  friend void reset();
+
+  const char* name_;
+  std::atomic<std::uint64_t> value_;
+  Counter* next_; //Intrusive, push-only registration list.
+};
+
+//Number of events each thread buffer holds before overwriting the oldest.
+constexpr std::size_t kEventsPerThread = 4096;
+
+void record(const char* name, const char* detail = nullptr,
+            const char* file = nullptr, std::uint32_t line = 0);
+
+//Snapshot of every buffered event, ordered by timestamp. Events being
+//overwritten while the snapshot is taken are dropped rather than torn.
+std::vector<Event> events();
+
+std::vector<CounterValue> counters();
+
+//Discards all buffered events and zeroes every counter. Not meant to race
+//with concurrent recording (events recorded meanwhile may or may not survive).
+void reset();
+
+void dumpChromeTrace(std::ostream& out);
+
+//Binary layout, all integers in native byte order, strings as a u16 length
+//followed by that many bytes (a null string is length 0xFFFF):
+//  "MEXT" u32:version(1)
+//  u32:counterCount { string:name u64:value }*
+//  u64:eventCount   { u64:timestampNs u32:threadId u32:line
+//                     string:name string:detail string:file }*
+void dumpBinary(std::ostream& out);
+
+//The counter named after EX: a single one per exception type, shared by every
+//Expected<TYPE> instantiation and translation unit.
+template<typename EX>
+Counter& counterFor() {
+  static Counter counter{typeid(EX).name()};
+  return counter;
+}
+
+namespace detail {
+  //Hook used by Expected.h under MEX_TRACE_EXPECTED.
+  void recordExpectedError(const char* exceptionType,
+                           const char* file, std::uint32_t line);
+} //namespace detail
+
+} //namespace trace
+} //namespace mex
@@ -0,0 +1,100 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <stdexcept>
+#include <exception>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+
+#include "Expected.h"
+#include "trace.h"
+
+/*
+ * The cost of tracing, in nanoseconds per operation:
+ *    * Expected construction on the value and error paths. Build this file
+ *      twice, with and without -DMEX_TRACE_EXPECTED (which must be defined
+ *      for the whole program, see trace.h), and compare the two outputs: the
+ *      difference is what the instrumentation costs.
+ *    * The primitives themselves, called directly, so available in either
+ *      build: recording an event in the per-thread ring buffer and bumping a
+ *      counter.
+ *
+ * Usage: traceBench [operations (default 2000000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::string;
+
+using mex::Expected;
+
+namespace trace = mex::trace;
+
+volatile std::int64_t sink = 0; //Keeps the results alive.
+
+template<typename RUN>
+void report(const string& name, std::size_t operations, RUN run) {
+  run(operations / 10); //Warm up.
+  const auto start = std::chrono::steady_clock::now();
+  run(operations);
+  const std::chrono::duration<double, std::nano> took =
+    std::chrono::steady_clock::now() - start;
+  cout << "  " << std::left << std::setw(34) << name << std::right << std::fixed
+       << std::setprecision(1) << std::setw(9) << took.count() / operations
+       << " ns" << endl;
+}
+
+int main(int argc, char** argv) {
+  const std::size_t operations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+#ifdef MEX_TRACE_EXPECTED
+  cout << "MEX_TRACE_EXPECTED on";
+#else
+  cout << "MEX_TRACE_EXPECTED off";
+#endif
+  cout << ", " << operations << " operations, per operation:" << endl;
+
+  report("Expected<int> from value", operations, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) {
+      Expected<int> e(static_cast<int>(i));
+      sink += e.get();
+    }
+  });
+  report("Expected<int> from exception", operations, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) {
+      Expected<int> e(std::runtime_error("bad input"));
+      sink += e.valid();
+    }
+  });
+  const std::exception_ptr error = std::make_exception_ptr(std::runtime_error("bad input"));
+  report("Expected<int> from exception_ptr", operations, [&error](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) {
+      Expected<int> e(error);
+      sink += e.valid();
+    }
+  });
+  report("fromCode, value", operations, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) {
+      auto e = Expected<int>::fromCode([i]() { return static_cast<int>(i); });
+      sink += e.get();
+    }
+  });
+  //Dominated by the throw itself, which tracing adds little to.
+  report("fromCode, throwing", operations / 10, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) {
+      auto e = Expected<int>::fromCode([]() -> int { throw std::runtime_error("bad input"); });
+      sink += e.valid();
+    }
+  });
+
+  report("trace::record (ring buffer event)", operations, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) trace::record("bench", "detail", __FILE__, __LINE__);
+  });
+  static trace::Counter counter("bench");
+  report("Counter::increment", operations, [](std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i) counter.increment();
+  });
+  sink += counter.value();
+  return 0;
+}
@@ -0,0 +1,176 @@
+
+//Normally a compiler flag (see trace.h); a #define is fine here since this is
+//the only translation unit of the test that includes Expected.h.
+#define MEX_TRACE_EXPECTED
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+#include <cassert>
+
+#include "Expected.h"
+#include "trace.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::thread;
+using std::ostringstream;
+using std::strcmp;
+
+using mex::Expected;
+namespace trace = mex::trace;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+static trace::Counter namespaceCounter{"traceTest.namespaceCounter"};
+
+std::uint64_t counterValue(const char* name) {
+  for(const auto& c : trace::counters()) {
+    if(strcmp(c.name, name) == 0) return c.value;
+  }
+  return 0;
+}
+
+Expected<int> failAt() {
+  return std::invalid_argument("traced");
+}
+
+MEX_UNIT_TEST
+  trace::reset();
+  namespaceCounter.increment();
+  namespaceCounter.increment(2);
+  for(int i = 0; i < 5; ++i) MEX_TRACE_COUNT("traceTest.macroCounter");
+  assert(counterValue("traceTest.namespaceCounter") == 3);
+  assert(counterValue("traceTest.macroCounter") == 5);
+
+  trace::reset();
+  assert(counterValue("traceTest.namespaceCounter") == 0);
+  assert(trace::events().empty());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  trace::reset();
+  MEX_TRACE_EVENT("first", "detail");
+  MEX_TRACE_EVENT("second", nullptr);
+
+  const auto events = trace::events();
+  assert(events.size() == 2);
+  assert(strcmp(events[0].name, "first") == 0);
+  assert(strcmp(events[0].detail, "detail") == 0);
+  assert(events[1].detail == nullptr);
+  assert(events[0].timestampNs <= events[1].timestampNs);
+  assert(events[0].threadId == events[1].threadId);
+  assert(events[0].line + 1 == events[1].line);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Overflowing the ring keeps only the newest events.
+  trace::reset();
+  const std::size_t total = trace::kEventsPerThread + 100;
+  for(std::size_t i = 0; i < total; ++i) {
+    trace::record("overflow", nullptr, nullptr, static_cast<std::uint32_t>(i));
+  }
+  const auto events = trace::events();
+  assert(events.size() == trace::kEventsPerThread);
+  assert(events.front().line == 100);
+  assert(events.back().line == total - 1);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  trace::reset();
+  const int perThread = 1000;
+  vector<thread> threads;
+  for(int t = 0; t < 4; ++t) {
+    threads.emplace_back([]() {
+      for(int i = 0; i < perThread; ++i) {
+        MEX_TRACE_EVENT("worker", nullptr);
+        MEX_TRACE_COUNT("traceTest.workerCounter");
+      }
+    });
+  }
+  //Dumping while the workers record must be safe.
+  for(int i = 0; i < 10; ++i) trace::events();
+  for(auto& t : threads) t.join();
+
+  assert(trace::events().size() == 4 * perThread);
+  assert(counterValue("traceTest.workerCounter") == 4 * perThread);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  trace::reset();
+  const std::uint32_t expectedLine = __LINE__ + 1;
+  Expected<int> direct = std::out_of_range("direct");
+  auto viaFunction = failAt();
+  Expected<int> valid = 5;
+  assert(!direct.valid() && !viaFunction.valid() && valid.valid());
+
+  const auto events = trace::events();
+  assert(events.size() == 2);
+  assert(strcmp(events[0].name, "Expected error") == 0);
+  assert(strcmp(events[0].detail, typeid(std::out_of_range).name()) == 0);
+  assert(strcmp(events[0].file, __FILE__) == 0);
+  assert(events[0].line == expectedLine);
+  assert(strcmp(events[1].detail, typeid(std::invalid_argument).name()) == 0);
+  assert(counterValue("mex.Expected.errors") == 2);
+  assert(counterValue(typeid(std::invalid_argument).name()) == 1);
+
+  //Other Expected instantiations share the per exception type counter.
+  Expected<double> other = std::invalid_argument("other");
+  assert(!other.valid());
+  std::size_t named = 0;
+  for(const auto& c : trace::counters()) {
+    if(strcmp(c.name, typeid(std::invalid_argument).name()) == 0) ++named;
+  }
+  assert(named == 1);
+  assert(counterValue(typeid(std::invalid_argument).name()) == 2);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //fromCode and fromException record their caller, not Expected.h.
+  trace::reset();
+  const std::uint32_t fromCodeLine = __LINE__ + 1;
+  auto wrapped = Expected<int>::fromCode([]() -> Expected<int> { throw std::runtime_error("x"); });
+  std::uint32_t fromExceptionLine = 0;
+  try {
+    throw std::runtime_error("y");
+  } catch(...) {
+    fromExceptionLine = __LINE__ + 1;
+    auto caught = Expected<int>::fromException();
+    assert(!caught.valid());
+  }
+  assert(!wrapped.valid());
+
+  const auto events = trace::events();
+  assert(events.size() == 2);
+  assert(strcmp(events[0].file, __FILE__) == 0 && events[0].line == fromCodeLine);
+  assert(strcmp(events[1].file, __FILE__) == 0 && events[1].line == fromExceptionLine);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  trace::reset();
+  MEX_TRACE_EVENT("needs \"escaping\"", "tab\there");
+  MEX_TRACE_COUNT("traceTest.dumpCounter");
+
+  ostringstream json;
+  trace::dumpChromeTrace(json);
+  assert(json.str().find("\"traceEvents\"") != string::npos);
+  assert(json.str().find("needs \\\"escaping\\\"") != string::npos);
+  assert(json.str().find("tab\\there") != string::npos);
+  assert(json.str().find("\"ph\":\"C\"") != string::npos);
+
+  ostringstream binary;
+  trace::dumpBinary(binary);
+  assert(binary.str().compare(0, 4, "MEXT") == 0);
+  assert(binary.str().find("traceTest.dumpCounter") != string::npos);
+MEX_END_UNIT_TEST
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+
+#include "Expected.h"
+#include "small_vector.h"
+#include "std_oversights.h"
+
+/*
+ *********************************OVERVIEW*************************************
+ * mex::view builds lazy pipelines over a range: a source, any number of
+ * stages (filter, remove_if, transform, take, chunk) and one terminal
+ * operation (forEach, count, collect, collectExpected).
+ *
+ * Nothing happens until the terminal operation runs. It then makes a single
+ * pass over the source, pushing each element through every stage in turn, so
+ * the whole pipeline compiles down to one loop - no intermediate containers
+ * and no allocation (chunk allocates only for chunks over 16 elements). A
+ * stage can end the pass early (take, or collectExpected on an error).
+ *
+ * Sources are given via from(), which takes anything mex::cbegin/mex::cend
+ * accept (so plain arrays work), or an iterator pair. The source must outlive
+ * the pipeline; the pipeline only holds iterators.
+ *
+ * Predicates and functions are copied into their stage and called as
+ * non-const lvalues, so mex::not_fn wrappers compose freely:
+ *
+   int raw[] = { 3, 8, 1, 6, 7 };
+   auto odd = [](int x) { return x % 2 != 0; };
+   auto evensSquared = mex::view::from(raw)
+                     | mex::view::filter(mex::not_fn(odd))
+                     | mex::view::transform([](int x) { return x * x; })
+                     | mex::view::take(10);
+   auto v = evensSquared.collect<std::vector<int>>(); // { 64, 36 }
+ *
+ * collectExpected<C>() expects the pipeline to produce Expected<TYPE>s. It
+ * collects the held TYPEs into a C, or stops at the first invalid Expected and
+ * returns that exception instead - Expected<C> either way:
+ *
+   auto parsed = mex::view::from(lines)
+               | mex::view::transform(parseInt) //Returns Expected<int>.
+               | mex::view::take(100);
+   Expected<std::vector<int>> numbers = parsed.collectExpected<std::vector<int>>();
+ *
+ * chunk(n) groups elements into runs of n (the last one may be shorter) and
+ * passes each on as a const reference to a small_vector that is reused, so a
+ * later stage must copy a chunk if it wants to keep it.
+ */
+
+namespace mex {
+namespace view {
+
+namespace detail {
+
+  //A stage describes how to wrap the sink downstream of it. A sink is called
+  //with each element and returns false once it wants no more; done() says so
+  //before the first element (take(0)), so that not even one is computed.
+  //finish() is called once the source is exhausted (or the pass was stopped).
+  //Output<In>::type is the element type a stage hands on, given its input.
+
+  struct Identity {
+    template<typename In> struct Output { using type = In; };
+
+    template<typename In, typename Down>
+    Down wrap(Down down) const { return down; }
+  };
+
+  template<typename First, typename Second>
+  struct Composed {
+    First first;
+    Second second;
+
+    template<typename In> struct Output {
+      using type = typename Second::template Output<
+        typename First::template Output<In>::type>::type;
+    };
+
+    template<typename In, typename Down>
+    auto wrap(Down down) const
+      -> decltype(std::declval<const First&>().template wrap<In>(
+           std::declval<const Second&>().template wrap<
+             typename First::template Output<In>::type>(down))) {
+      return first.template wrap<In>(
+        second.template wrap<typename First::template Output<In>::type>(down));
+    }
+  };
+
+  template<typename PRED, typename Down>
+  struct FilterSink {
+    PRED pred;
+    Down down;
+    template<typename T>
+    bool operator()(T&& value) {
+      return pred(value) ? down(std::forward<T>(value)) : true;
+    }
+    bool done() const { return down.done(); }
+    void finish() { down.finish(); }
+  };
+
+  template<typename PRED>
+  struct FilterStage {
+    PRED pred;
+    template<typename In> struct Output { using type = In; };
+    template<typename In, typename Down>
+    FilterSink<PRED, Down> wrap(Down down) const { return {pred, down}; }
+  };
+
+  template<typename FUNC, typename Down>
+  struct TransformSink {
+    FUNC fun;
+    Down down;
+    template<typename T>
+    bool operator()(T&& value) { return down(fun(std::forward<T>(value))); }
+    bool done() const { return down.done(); }
+    void finish() { down.finish(); }
+  };
+
+  template<typename FUNC>
+  struct TransformStage {
+    FUNC fun;
+    template<typename In> struct Output {
+      using type = typename std::result_of<FUNC&(In)>::type;
+    };
+    template<typename In, typename Down>
+    TransformSink<FUNC, Down> wrap(Down down) const { return {fun, down}; }
+  };
+
+  template<typename Down>
+  struct TakeSink {
+    std::size_t remaining;
+    Down down;
+    template<typename T>
+    bool operator()(T&& value) {
+      if(remaining == 0) return false;
+      --remaining;
+      return down(std::forward<T>(value)) && remaining > 0;
+    }
+    bool done() const { return remaining == 0 || down.done(); }
+    void finish() { down.finish(); }
+  };
+
+  struct TakeStage {
+    std::size_t count;
+    template<typename In> struct Output { using type = In; };
+    template<typename In, typename Down>
+    TakeSink<Down> wrap(Down down) const { return {count, down}; }
+  };
+
+  template<typename In>
+  using ChunkBuffer = small_vector<typename std::decay<In>::type, 16>;
+
+  template<typename In, typename Down>
+  struct ChunkSink {
+    std::size_t size;
+    Down down;
+    ChunkBuffer<In> buffer;
+    bool stopped;
+
+    template<typename T>
+    bool operator()(T&& value) {
+      buffer.push_back(std::forward<T>(value));
+      if(buffer.size() < size) return true;
+      stopped = !down(static_cast<const ChunkBuffer<In>&>(buffer));
+      buffer.clear();
+      return !stopped;
+    }
+    bool done() const { return stopped || down.done(); }
+    void finish() {
+      if(!stopped && !buffer.empty()) {
+        down(static_cast<const ChunkBuffer<In>&>(buffer));
+      }
+      down.finish();
+    }
+  };
+
+  struct ChunkStage {
+    std::size_t size;
+    template<typename In> struct Output { using type = const ChunkBuffer<In>&; };
+    template<typename In, typename Down>
+    ChunkSink<In, Down> wrap(Down down) const {
+      return {size, down, ChunkBuffer<In>(), false};
+    }
+  };
+
+  //Terminal sinks are wrapped by pointer so the terminal can read its result.
+  template<typename TERMINAL>
+  struct TerminalRef {
+    TERMINAL* terminal;
+    template<typename T>
+    bool operator()(T&& value) { return (*terminal)(std::forward<T>(value)); }
+    bool done() const { return false; }
+    void finish() {}
+  };
+
+  template<typename FUNC>
+  struct ForEachTerminal {
+    FUNC fun;
+    template<typename T>
+    bool operator()(T&& value) {
+      fun(std::forward<T>(value));
+      return true;
+    }
+  };
+
+  struct CountTerminal {
+    std::size_t count;
+    template<typename T>
+    bool operator()(T&&) {
+      ++count;
+      return true;
+    }
+  };
+
+  template<typename CONTAINER>
+  struct CollectTerminal {
+    CONTAINER out;
+    template<typename T>
+    bool operator()(T&& value) {
+      out.push_back(std::forward<T>(value));
+      return true;
+    }
+  };
+
+  template<typename CONTAINER>
+  struct CollectExpectedTerminal {
+    CONTAINER out;
+    std::exception_ptr error;
+    template<typename T>
+    bool operator()(T&& expected) {
+      if(!expected.valid()) {
+        //Expected only hands its exception out by throwing it.
+        try {
+          expected.throwException();
+        } catch(...) {
+          error = std::current_exception();
+        }
+        return false;
+      }
+      //Move the value out of an rvalue Expected, so move-only types work.
+      using Held = decltype(expected.get());
+      using Value = typename std::conditional<std::is_lvalue_reference<T>::value,
+        Held, typename std::remove_reference<Held>::type>::type;
+      out.push_back(std::forward<Value>(expected.get()));
+      return true;
+    }
+  };
+
+  template<typename T>
+  struct IsExpected : std::false_type {};
+  template<typename TYPE, typename ENABLE>
+  struct IsExpected<Expected<TYPE, ENABLE>> : std::true_type {};
+
+} //namespace detail
+
+template<typename It, typename STAGES = detail::Identity>
+class Pipeline {
+public:
+  using reference = typename std::iterator_traits<It>::reference;
+  //Type of the elements reaching the terminal operation.
+  using output_type = typename STAGES::template Output<reference>::type;
+
+  Pipeline(It first, It last, STAGES stages = STAGES())
+    : first_(first), last_(last), stages_(stages) {}
+
+  template<typename STAGE>
+  Pipeline<It, detail::Composed<STAGES, STAGE>> then(STAGE stage) const {
+    return {first_, last_, detail::Composed<STAGES, STAGE>{stages_, stage}};
+  }
+
+  template<typename FUNC>
+  void forEach(FUNC fun) const {
+    detail::ForEachTerminal<FUNC> terminal{fun};
+    run(terminal);
+  }
+
+  std::size_t count() const {
+    detail::CountTerminal terminal{0};
+    run(terminal);
+    return terminal.count;
+  }
+
+  template<typename CONTAINER>
+  CONTAINER collect() const {
+    detail::CollectTerminal<CONTAINER> terminal{CONTAINER()};
+    run(terminal);
+    return std::move(terminal.out);
+  }
+
+  template<typename CONTAINER>
+  Expected<CONTAINER> collectExpected() const {
+    static_assert(detail::IsExpected<typename std::decay<output_type>::type>::value,
+                  "collectExpected requires a pipeline producing Expected values");
+    detail::CollectExpectedTerminal<CONTAINER> terminal{CONTAINER(), nullptr};
+    run(terminal);
+    if(terminal.error) return Expected<CONTAINER>(terminal.error);
+    return Expected<CONTAINER>(std::move(terminal.out));
+  }
+
+private:
+  template<typename TERMINAL>
+  void run(TERMINAL& terminal) const {
+    auto sink = stages_.template wrap<reference>(
+      detail::TerminalRef<TERMINAL>{&terminal});
+    if(!sink.done()) {
+      for(auto itr = first_; itr != last_; ++itr) {
+        if(!sink(*itr)) break;
+      }
+    }
+    sink.finish();
+  }
+
+  It first_;
+  It last_;
+  STAGES stages_;
+};
+
+template<typename It>
+Pipeline<It> from(It first, It last) {
+  return Pipeline<It>(first, last);
+}
+
+template<typename C>
+auto from(const C& c) -> Pipeline<decltype(mex::cbegin(c))> {
+  return from(mex::cbegin(c), mex::cend(c));
+}
+
+//A pipeline only holds iterators, which would dangle into a temporary.
+template<typename C>
+void from(const C&&) = delete;
+
+template<typename PRED>
+detail::FilterStage<typename std::decay<PRED>::type> filter(PRED&& pred) {
+  return {std::forward<PRED>(pred)};
+}
+
+template<typename PRED>
+auto remove_if(PRED&& pred) -> decltype(filter(mex::not_fn(std::forward<PRED>(pred)))) {
+  return filter(mex::not_fn(std::forward<PRED>(pred)));
+}
+
+template<typename FUNC>
+detail::TransformStage<typename std::decay<FUNC>::type> transform(FUNC&& fun) {
+  return {std::forward<FUNC>(fun)};
+}
+
+inline detail::TakeStage take(std::size_t count) {
+  return {count};
+}
+
+//n must be at least 1.
+inline detail::ChunkStage chunk(std::size_t n) {
+  return {n};
+}
+
+template<typename It, typename STAGES, typename STAGE>
+auto operator|(const Pipeline<It, STAGES>& pipeline, STAGE stage)
+  -> decltype(pipeline.then(stage)) {
+  return pipeline.then(stage);
+}
+
+} //namespace view
+} //namespace mex
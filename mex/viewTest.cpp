@@ -0,0 +1,133 @@
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+
+#include "Expected.h"
+#include "view.h"
+#include "std_oversights.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::list;
+using std::string;
+
+using mex::Expected;
+using mex::not_fn;
+using mex::operator"" _s;
+
+namespace view = mex::view;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+bool isOdd(int x) { return x % 2 != 0; }
+
+Expected<int> checkedHalf(int x) {
+  if(x % 2) return std::invalid_argument("odd");
+  return x / 2;
+}
+
+//Counts how often it is called, to check stages run lazily and only once.
+struct CountingSquare {
+  int* calls;
+  int operator()(int x) { ++*calls; return x * x; }
+};
+
+MEX_UNIT_TEST
+  int raw[] = { 3, 8, 1, 6, 7, 4 };
+  const auto evensSquared = view::from(raw)
+                          | view::filter(not_fn(isOdd))
+                          | view::transform([](int x) { return x * x; });
+  assert((evensSquared.collect<vector<int>>() == vector<int>{ 64, 36, 16 }));
+  assert(evensSquared.count() == 3);
+
+  //remove_if is filter with a negated predicate.
+  assert(((view::from(raw) | view::remove_if(isOdd)).collect<vector<int>>() ==
+          vector<int>{ 8, 6, 4 }));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  vector<int> v { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+  int calls = 0;
+  const auto pipeline = view::from(v)
+                      | view::transform(CountingSquare{&calls})
+                      | view::take(3);
+  assert(calls == 0); //Nothing happens until a terminal operation.
+  assert((pipeline.collect<vector<int>>() == vector<int>{ 1, 4, 9 }));
+  assert(calls == 3); //take stops the pass early.
+
+  assert((view::from(v) | view::take(0)).count() == 0);
+  assert((view::from(v) | view::transform(CountingSquare{&calls}) | view::take(0)
+          | view::chunk(2)).count() == 0);
+  assert(calls == 3); //take(0) does not even compute the first element.
+  assert((view::from(v) | view::take(100)).count() == v.size());
+
+  list<string> words { "a", "bb", "ccc" };
+  string joined;
+  (view::from(words) | view::filter([](const string& s) { return s.size() > 1; }))
+    .forEach([&](const string& s) { joined += s; });
+  assert(joined == "bbccc");
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  int raw[] = { 1, 2, 3, 4, 5, 6, 7 };
+  vector<int> sums;
+  (view::from(raw) | view::chunk(3)).forEach([&](const mex::small_vector<int, 16>& c) {
+    int sum = 0;
+    for(int x : c) sum += x;
+    sums.push_back(sum);
+  });
+  assert((sums == vector<int>{ 6, 15, 7 }));
+
+  //Chunk after take flushes the partial chunk; take after chunk counts chunks.
+  assert((view::from(raw) | view::take(4) | view::chunk(3)).count() == 2);
+  assert((view::from(raw) | view::chunk(2) | view::take(2)).count() == 2);
+  assert((view::from(raw) | view::chunk(2) | view::take(2)
+          | view::transform([](const mex::small_vector<int, 16>& c) { return c.back(); }))
+         .collect<vector<int>>() == (vector<int>{ 2, 4 }));
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  vector<int> allEven { 2, 4, 6, 8 };
+  auto halves = (view::from(allEven) | view::transform(checkedHalf))
+                .collectExpected<vector<int>>();
+  assert(halves.valid());
+  assert((halves.get() == vector<int>{ 1, 2, 3, 4 }));
+
+  int calls = 0;
+  vector<int> someOdd { 2, 4, 5, 6 };
+  auto failed = (view::from(someOdd)
+                 | view::transform(CountingSquare{&calls})
+                 | view::transform(checkedHalf))
+                .collectExpected<vector<int>>();
+  assert(!failed.valid());
+  assert(failed.hasException<std::invalid_argument>());
+  assert(calls == 3); //Stopped at the first invalid Expected.
+
+  //Values are moved out of the Expected temporaries, so move-only types work.
+  auto owned = (view::from(allEven)
+                | view::transform([](int i) {
+                    return Expected<std::unique_ptr<int>>(std::unique_ptr<int>(new int(i)));
+                  }))
+               .collectExpected<vector<std::unique_ptr<int>>>();
+  assert(owned.valid() && owned.get().size() == 4 && *owned.get()[3] == 8);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  const char text[] = "hello world";
+  auto upper = (view::from(text, text + 11)
+                | view::filter([](char c) { return c != ' '; })
+                | view::transform([](char c) { return char(c - 'a' + 'A'); }))
+               .collect<string>();
+  assert(upper == "HELLOWORLD"_s);
+MEX_END_UNIT_TEST
@@ -0,0 +1,155 @@
+#include "wire.h"
+
+#include <new>
+#include <system_error>
+
+using std::int32_t;
+using std::uint32_t;
+using std::size_t;
+using std::string;
+using std::vector;
+using std::exception;
+using std::exception_ptr;
+using std::type_index;
+using std::mutex;
+using std::lock_guard;
+
+namespace mex {
+namespace wire {
+
+RemoteError::RemoteError(uint32_t tag, int32_t code, const string& message)
+  : std::runtime_error(message), tag_(tag), code_(code) {}
+
+namespace {
+
+  //libstdc++ and libc++ both append ": " and the code's description to the
+  //message a system_error is built with; strip it so it is not doubled when
+  //the exception is rebuilt.
+  void inspectSystemError(const exception& ex, ErrorInfo& info) {
+    const auto& error = static_cast<const std::system_error&>(ex);
+    info.code = error.code().value();
+    const string suffix = ": " + error.code().message();
+    if(info.message.size() >= suffix.size() &&
+       info.message.compare(info.message.size() - suffix.size(),
+                            suffix.size(), suffix) == 0) {
+      info.message.resize(info.message.size() - suffix.size());
+    }
+  }
+
+} //namespace
+
+ErrorRegistry::ErrorRegistry() {
+  //The tags of the standard exceptions are part of the format: never reuse.
+  add<std::logic_error>(1);
+  add<std::invalid_argument>(2);
+  add<std::domain_error>(3);
+  add<std::length_error>(4);
+  add<std::out_of_range>(5);
+  add<std::runtime_error>(6);
+  add<std::range_error>(7);
+  add<std::overflow_error>(8);
+  add<std::underflow_error>(9);
+  add(10, typeid(std::system_error), [](const string& message, int32_t code) {
+    return std::make_exception_ptr(
+      std::system_error(code, std::generic_category(), message));
+  }, inspectSystemError);
+  add(11, typeid(std::bad_alloc), [](const string&, int32_t) {
+    return std::make_exception_ptr(std::bad_alloc());
+  });
+}
+
+ErrorRegistry& ErrorRegistry::global() {
+  static ErrorRegistry registry;
+  return registry;
+}
+
+void ErrorRegistry::add(uint32_t tag, const std::type_info& type,
+                        Factory make, Inspect inspect) {
+  if(tag == kUnregisteredTag) throw std::invalid_argument("tag 0 is reserved");
+  lock_guard<mutex> lock(mutex_);
+  if(byTag_.count(tag)) throw std::invalid_argument("tag already registered");
+  if(byType_.count(type_index(type))) {
+    throw std::invalid_argument("type already registered");
+  }
+  byType_.emplace(type_index(type), Entry{tag, std::move(make), std::move(inspect)});
+  byTag_.emplace(tag, type_index(type));
+}
+
+ErrorInfo ErrorRegistry::describe(const exception& ex) const {
+  if(const auto* remote = dynamic_cast<const RemoteError*>(&ex)) {
+    return ErrorInfo{remote->tag(), remote->code(), remote->what()};
+  }
+  ErrorInfo info{kUnregisteredTag, 0, ex.what()};
+  Inspect inspect;
+  {
+    lock_guard<mutex> lock(mutex_);
+    const auto found = byType_.find(type_index(typeid(ex)));
+    if(found == byType_.end()) return info;
+    info.tag = found->second.tag;
+    inspect = found->second.inspect;
+  }
+  if(inspect) inspect(ex, info);
+  return info;
+}
+
+exception_ptr ErrorRegistry::rebuild(uint32_t tag, const string& message,
+                                     int32_t code) const {
+  Factory make;
+  {
+    lock_guard<mutex> lock(mutex_);
+    const auto found = byTag_.find(tag);
+    if(found != byTag_.end()) make = byType_.at(found->second).make;
+  }
+  if(!make) return std::make_exception_ptr(RemoteError(tag, code, message));
+  return make(message, code);
+}
+
+exception_ptr ErrorView::rebuild(const ErrorRegistry& registry) const {
+  return registry.rebuild(tag, string(message, messageLength), code);
+}
+
+namespace detail {
+
+  size_t errorPayloadSize(const ErrorInfo& info) {
+    return padded(sizeof(ErrorHeader) + info.message.size() + 1);
+  }
+
+  void writeErrorPayload(char* at, const ErrorInfo& info) {
+    const ErrorHeader header{
+      info.tag, info.code, static_cast<uint32_t>(info.message.size()), 0
+    };
+    const size_t used = sizeof(header) + info.message.size() + 1;
+    std::memcpy(at, &header, sizeof(header));
+    std::memcpy(at + sizeof(header), info.message.c_str(), info.message.size() + 1);
+    std::memset(at + used, 0, padded(used) - used);
+  }
+
+  void appendErrorPayload(vector<char>& out, const ErrorInfo& info) {
+    const size_t at = out.size();
+    out.resize(at + errorPayloadSize(info));
+    writeErrorPayload(&out[at], info);
+  }
+
+  ErrorView readErrorPayload(const char* at, size_t available) {
+    if(available < sizeof(ErrorHeader)) throw FormatError("truncated error header");
+    const auto header = readRaw<ErrorHeader>(at);
+    if(header.messageLength >= available - sizeof(ErrorHeader)) {
+      throw FormatError("truncated error message");
+    }
+    const char* message = at + sizeof(ErrorHeader);
+    if(message[header.messageLength] != '\0') {
+      throw FormatError("unterminated error message");
+    }
+    return ErrorView{header.tag, header.code, message, header.messageLength};
+  }
+
+  void checkAligned(const char* data) {
+    if(reinterpret_cast<std::uintptr_t>(data) % kAlignment != 0) {
+      throw FormatError("buffer is not 8 byte aligned");
+    }
+  }
+
+} //namespace detail
+
+} //namespace wire
+} //namespace mex
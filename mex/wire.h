@@ -0,0 +1,576 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Expected.h"
+
+/*
+ *********************************OVERVIEW*************************************
+ * mex::wire serializes Expected<TYPE>s into a compact binary form so results
+ * can travel between processes (over a pipe, through shared memory, via a
+ * file) - an exception_ptr cannot leave the process it was created in.
+ *
+ * TYPE must be trivially copyable: a value is stored as its raw bytes. An
+ * error is stored as a type tag, an integer code and the what() message. On
+ * the way back in, an ErrorRegistry turns the tag into an exception of the
+ * original concrete type again (std::invalid_argument comes back as a
+ * std::invalid_argument). Exceptions whose type is not registered arrive as a
+ * mex::wire::RemoteError carrying the tag, code and message.
+ *
+ * Two formats are offered:
+ *    * Records: one Expected<TYPE> each, written with encode() and read with
+ *      RecordView<TYPE> or decode(). Records can simply be concatenated.
+ *    * Batches: an array of Expected<TYPE>s, written with encodeBatch() and
+ *      read with BatchView<TYPE>. The values are laid out as a plain TYPE
+ *      array (with zeroed slots where an error sits), so a batch of mostly
+ *      valid results can be consumed as a TYPE* straight out of the buffer.
+ *
+ * The views never copy or allocate: they read the buffer in place, which may
+ * well be a region mapped from another process. Only turning an error back
+ * into an exception (ErrorView::rebuild, RecordView::toExpected,
+ * BatchView::at) allocates. A buffer that is truncated or otherwise malformed
+ * makes the views throw a FormatError rather than read out of bounds.
+ *
+ * Everything is written at 8 byte aligned offsets (relative to the start of
+ * the output vector) and in native byte order: the format is meant for
+ * processes on one machine, not for storage or the network. The views
+ * require the buffer they are handed to be 8 byte aligned.
+ *
+ ********************************LAYOUT****************************************
+ * All sections are padded to a multiple of 8 bytes.
+ *
+ * Record: u32:kind(0 value, 1 error) u32:payloadSize  payload
+ *   value payload: the bytes of the TYPE
+ *   error payload: u32:tag i32:code u32:messageLength u32:0  message '\0'
+ *
+ * Batch:  "MEXB" u32:version(1) u32:sizeof(TYPE) u32:alignof(TYPE)
+ *         u64:count u64:errorCount u64:totalSize
+ *         TYPE values[count]
+ *         u64 validBits[(count + 63) / 64]
+ *         { u64:index u64:offset }[errorCount] - sorted by index, the offset
+ *                                                (from the batch start) of
+ *         error payloads                         the error payload
+ *
+ ********************************EXAMPLE***************************************
+ *
+   //In the worker:
+   std::vector<char> out;
+   mex::wire::encodeBatch(results.begin(), results.end(), out);
+   writeAll(pipeFd, out.data(), out.size());
+
+   //In the parent, with the bytes in an 8 byte aligned buffer:
+   mex::wire::BatchView<Point> batch(buffer, length);
+   for(std::size_t i = 0; i < batch.size(); ++i) {
+     if(batch.valid(i)) plot(batch.value(i));
+     else log(batch.error(i).message);
+   }
+   Expected<Point> third = batch.at(2); //Rethrows as the original type.
+ *
+ * Registering an application exception, on both sides, under the same tag:
+ *
+   mex::wire::ErrorRegistry::global().add<ParseError>(mex::wire::kFirstUserTag);
+ */
+
+namespace mex {
+namespace wire {
+
+//Thrown by the views when a buffer does not hold what it should.
+class FormatError : public std::runtime_error {
+public:
+  explicit FormatError(const std::string& what) : std::runtime_error(what) {}
+};
+
+//Stands in for an exception whose type the receiving process cannot rebuild.
+class RemoteError : public std::runtime_error {
+public:
+  RemoteError(std::uint32_t tag, std::int32_t code, const std::string& message);
+
+  std::uint32_t tag() const { return tag_; }
+  std::int32_t code() const { return code_; }
+
+private:
+  std::uint32_t tag_;
+  std::int32_t code_;
+};
+
+//Tag given to exceptions of unregistered types.
+constexpr std::uint32_t kUnregisteredTag = 0;
+//Tags below this one are reserved for the standard exceptions.
+constexpr std::uint32_t kFirstUserTag = 1024;
+
+struct ErrorInfo {
+  std::uint32_t tag;
+  std::int32_t code;
+  std::string message;
+};
+
+//Maps exception types to tags and back. The default constructed registry (and
+//so global()) already knows the <stdexcept> exceptions, std::system_error
+//(whose code is its error_code's value) and std::bad_alloc. All members are
+//thread safe.
+class ErrorRegistry {
+public:
+  //Builds the exception to rethrow from a message and code.
+  using Factory = std::function<std::exception_ptr(const std::string& message,
+                                                   std::int32_t code)>;
+  //Fills in the code of an ErrorInfo (tag and message are preset to the
+  //registered tag and what()); may also adjust the message.
+  using Inspect = std::function<void(const std::exception& ex, ErrorInfo& info)>;
+
+  ErrorRegistry();
+
+  static ErrorRegistry& global();
+
+  //Registers EX, rebuilt via EX(message), with a code of 0.
+  template<typename EX>
+  void add(std::uint32_t tag);
+
+  //Throws std::invalid_argument if the tag or type is taken or the tag is
+  //kUnregisteredTag.
+  void add(std::uint32_t tag, const std::type_info& type,
+           Factory make, Inspect inspect = nullptr);
+
+  //Matches on the exact dynamic type of ex; a RemoteError keeps its tag.
+  ErrorInfo describe(const std::exception& ex) const;
+
+  std::exception_ptr rebuild(std::uint32_t tag, const std::string& message,
+                             std::int32_t code) const;
+
+private:
+  struct Entry {
+    std::uint32_t tag;
+    Factory make;
+    Inspect inspect;
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::type_index, Entry> byType_;
+  std::unordered_map<std::uint32_t, std::type_index> byTag_;
+};
+
+//An error payload, read in place.
+struct ErrorView {
+  std::uint32_t tag;
+  std::int32_t code;
+  const char* message; //Points into the buffer and is '\0' terminated.
+  std::uint32_t messageLength;
+
+  std::exception_ptr rebuild(const ErrorRegistry& registry = ErrorRegistry::global()) const;
+};
+
+namespace detail {
+
+  struct RecordHeader {
+    std::uint32_t kind;
+    std::uint32_t payloadSize;
+  };
+
+  struct ErrorHeader {
+    std::uint32_t tag;
+    std::int32_t code;
+    std::uint32_t messageLength;
+    std::uint32_t reserved;
+  };
+
+  struct BatchHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t valueSize;
+    std::uint32_t valueAlign;
+    std::uint64_t count;
+    std::uint64_t errorCount;
+    std::uint64_t totalSize;
+  };
+
+  struct IndexEntry {
+    std::uint64_t index;
+    std::uint64_t offset;
+  };
+
+  constexpr std::uint32_t kValueRecord = 0;
+  constexpr std::uint32_t kErrorRecord = 1;
+  constexpr std::uint32_t kBatchVersion = 1;
+  constexpr std::size_t kAlignment = 8;
+
+  inline std::size_t padded(std::size_t n) {
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+  }
+
+  //Grows out to the next aligned size with zero bytes.
+  inline void pad(std::vector<char>& out) {
+    out.resize(padded(out.size()), 0);
+  }
+
+  inline void append(std::vector<char>& out, const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+  }
+
+  template<typename POD>
+  POD readRaw(const char* at) {
+    POD result;
+    std::memcpy(&result, at, sizeof(POD));
+    return result;
+  }
+
+  std::size_t errorPayloadSize(const ErrorInfo& info);
+  //Writes errorPayloadSize(info) bytes, padding included.
+  void writeErrorPayload(char* at, const ErrorInfo& info);
+  void appendErrorPayload(std::vector<char>& out, const ErrorInfo& info);
+  //Checks the payload fits in [at, at + available).
+  ErrorView readErrorPayload(const char* at, std::size_t available);
+  void checkAligned(const char* data);
+
+  template<typename TYPE>
+  ErrorInfo describeHeld(const Expected<TYPE>& expected,
+                         const ErrorRegistry& registry) {
+    //Expected only hands its exception out by throwing it.
+    try {
+      expected.throwException();
+    } catch(const std::exception& ex) {
+      return registry.describe(ex);
+    } catch(...) {
+    }
+    return ErrorInfo{kUnregisteredTag, 0, "unknown exception"};
+  }
+
+  template<typename T>
+  struct ExpectedType;
+  template<typename TYPE, typename ENABLE>
+  struct ExpectedType<Expected<TYPE, ENABLE>> { using type = TYPE; };
+
+  template<typename TYPE>
+  void checkWireable() {
+    static_assert(std::is_trivially_copyable<TYPE>::value,
+                  "mex::wire only serializes trivially copyable TYPEs");
+    static_assert(alignof(TYPE) <= kAlignment,
+                  "mex::wire values may need at most 8 byte alignment");
+  }
+
+} //namespace detail
+
+//Appends a record holding expected to out.
+template<typename TYPE>
+void encode(const Expected<TYPE>& expected, std::vector<char>& out,
+            const ErrorRegistry& registry = ErrorRegistry::global());
+
+//Bytes a record of TYPE takes at most when error messages are limited to
+//maxMessageLength.
+template<typename TYPE>
+std::size_t recordCapacity(std::size_t maxMessageLength);
+
+//Writes a record holding expected straight into [out, out + capacity), which
+//must be 8 byte aligned and at least recordCapacity<TYPE>(0) bytes (else
+//std::invalid_argument is thrown); an error message that does not fit is
+//truncated. Returns the bytes written.
+template<typename TYPE>
+std::size_t encodeInPlace(const Expected<TYPE>& expected, char* out, std::size_t capacity,
+                          const ErrorRegistry& registry = ErrorRegistry::global());
+
+//A record, read in place.
+template<typename TYPE>
+class RecordView {
+public:
+  //data must be 8 byte aligned; size may extend past the record.
+  RecordView(const char* data, std::size_t size);
+
+  bool valid() const { return kind_ == detail::kValueRecord; }
+
+  //The value inside the buffer. Throws the rebuilt error if not valid.
+  const TYPE& value() const;
+
+  //Precondition: !valid().
+  ErrorView error() const { return error_; }
+
+  Expected<TYPE> toExpected(const ErrorRegistry& registry = ErrorRegistry::global()) const;
+
+  //Bytes the record occupies, so that concatenated records can be walked.
+  std::size_t byteSize() const { return byteSize_; }
+
+private:
+  const char* payload_;
+  std::uint32_t kind_;
+  std::size_t byteSize_;
+  ErrorView error_;
+};
+
+template<typename TYPE>
+Expected<TYPE> decode(const char* data, std::size_t size,
+                      const ErrorRegistry& registry = ErrorRegistry::global());
+
+//Appends a batch holding the Expected<TYPE>s in [first, last) to out.
+template<typename ForwardIt>
+void encodeBatch(ForwardIt first, ForwardIt last, std::vector<char>& out,
+                 const ErrorRegistry& registry = ErrorRegistry::global());
+
+//A batch, read in place.
+template<typename TYPE>
+class BatchView {
+public:
+  //data must be 8 byte aligned; size may extend past the batch.
+  BatchView(const char* data, std::size_t size);
+
+  std::size_t size() const { return count_; }
+  std::size_t errorCount() const { return errorCount_; }
+
+  //Throws std::out_of_range if i >= size(), as does at().
+  bool valid(std::size_t i) const {
+    if(i >= count_) throw std::out_of_range("BatchView index out of range");
+    return (validBits_[i / 64] >> (i % 64)) & 1;
+  }
+
+  //All size() values; the slots of errors are zeroed.
+  const TYPE* values() const { return values_; }
+
+  //Unchecked. Precondition: i < size() and valid(i).
+  const TYPE& value(std::size_t i) const { return values_[i]; }
+
+  //Precondition: !valid(i). Looked up by binary search over the errors.
+  ErrorView error(std::size_t i) const;
+
+  Expected<TYPE> at(std::size_t i,
+                    const ErrorRegistry& registry = ErrorRegistry::global()) const;
+
+  std::size_t byteSize() const { return byteSize_; }
+
+private:
+  const char* data_;
+  const TYPE* values_;
+  const std::uint64_t* validBits_;
+  const char* index_;
+  std::size_t count_;
+  std::size_t errorCount_;
+  std::size_t byteSize_;
+};
+
+
+/******************************************************************************
+ ******************************************************************************
+ *******************************INLINE FUNCTIONS*******************************
+ ******************************************************************************
+ *****************************************************************************/
+
+template<typename EX>
+void ErrorRegistry::add(std::uint32_t tag) {
+  static_assert(std::is_base_of<std::exception, EX>::value,
+                "Only std::exceptions can be registered");
+  add(tag, typeid(EX), [](const std::string& message, std::int32_t) {
+    return std::make_exception_ptr(EX(message));
+  });
+}
+
+template<typename TYPE>
+void encode(const Expected<TYPE>& expected, std::vector<char>& out,
+            const ErrorRegistry& registry) {
+  detail::checkWireable<TYPE>();
+  detail::pad(out);
+  if(expected.valid()) {
+    const detail::RecordHeader header{detail::kValueRecord, sizeof(TYPE)};
+    detail::append(out, &header, sizeof(header));
+    detail::append(out, &expected.get(), sizeof(TYPE));
+    detail::pad(out);
+  } else {
+    const ErrorInfo info = detail::describeHeld(expected, registry);
+    const detail::RecordHeader header{
+      detail::kErrorRecord,
+      static_cast<std::uint32_t>(detail::errorPayloadSize(info))
+    };
+    detail::append(out, &header, sizeof(header));
+    detail::appendErrorPayload(out, info);
+  }
+}
+
+template<typename TYPE>
+std::size_t recordCapacity(std::size_t maxMessageLength) {
+  const std::size_t error = sizeof(detail::ErrorHeader) + maxMessageLength + 1;
+  return sizeof(detail::RecordHeader) +
+         detail::padded(sizeof(TYPE) > error ? sizeof(TYPE) : error);
+}
+
+template<typename TYPE>
+std::size_t encodeInPlace(const Expected<TYPE>& expected, char* out, std::size_t capacity,
+                          const ErrorRegistry& registry) {
+  detail::checkWireable<TYPE>();
+  if(capacity < recordCapacity<TYPE>(0)) {
+    throw std::invalid_argument("record capacity too small");
+  }
+  if(expected.valid()) {
+    const detail::RecordHeader header{detail::kValueRecord, sizeof(TYPE)};
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), &expected.get(), sizeof(TYPE));
+    return sizeof(header) + detail::padded(sizeof(TYPE));
+  }
+  ErrorInfo info = detail::describeHeld(expected, registry);
+  //The payload is padded to 8 bytes, so only whole words of capacity count.
+  const std::size_t room = (capacity & ~(detail::kAlignment - 1))
+                         - sizeof(detail::RecordHeader)
+                         - sizeof(detail::ErrorHeader) - 1;
+  if(info.message.size() > room) info.message.resize(room);
+  const std::size_t payloadSize = detail::errorPayloadSize(info);
+  const detail::RecordHeader header{
+    detail::kErrorRecord, static_cast<std::uint32_t>(payloadSize)
+  };
+  std::memcpy(out, &header, sizeof(header));
+  detail::writeErrorPayload(out + sizeof(header), info);
+  return sizeof(header) + payloadSize;
+}
+
+template<typename TYPE>
+RecordView<TYPE>::RecordView(const char* data, std::size_t size) {
+  detail::checkWireable<TYPE>();
+  detail::checkAligned(data);
+  if(size < sizeof(detail::RecordHeader)) throw FormatError("truncated record header");
+  const auto header = detail::readRaw<detail::RecordHeader>(data);
+  payload_ = data + sizeof(header);
+  kind_ = header.kind;
+  byteSize_ = sizeof(header) + detail::padded(header.payloadSize);
+  if(byteSize_ > size) throw FormatError("truncated record");
+
+  if(kind_ == detail::kValueRecord) {
+    if(header.payloadSize != sizeof(TYPE)) throw FormatError("record holds another type");
+    error_ = ErrorView{0, 0, nullptr, 0};
+  } else if(kind_ == detail::kErrorRecord) {
+    error_ = detail::readErrorPayload(payload_, header.payloadSize);
+  } else {
+    throw FormatError("unknown record kind");
+  }
+}
+
+template<typename TYPE>
+const TYPE& RecordView<TYPE>::value() const {
+  if(!valid()) std::rethrow_exception(error_.rebuild());
+  return *reinterpret_cast<const TYPE*>(payload_);
+}
+
+template<typename TYPE>
+Expected<TYPE> RecordView<TYPE>::toExpected(const ErrorRegistry& registry) const {
+  if(valid()) return Expected<TYPE>(*reinterpret_cast<const TYPE*>(payload_));
+  return Expected<TYPE>(error_.rebuild(registry));
+}
+
+template<typename TYPE>
+Expected<TYPE> decode(const char* data, std::size_t size,
+                      const ErrorRegistry& registry) {
+  return RecordView<TYPE>(data, size).toExpected(registry);
+}
+
+template<typename ForwardIt>
+void encodeBatch(ForwardIt first, ForwardIt last, std::vector<char>& out,
+                 const ErrorRegistry& registry) {
+  using TYPE = typename detail::ExpectedType<
+    typename std::iterator_traits<ForwardIt>::value_type>::type;
+  detail::checkWireable<TYPE>();
+
+  detail::pad(out);
+  const std::size_t start = out.size();
+  const std::size_t count = std::distance(first, last);
+  const std::size_t valuesAt = start + sizeof(detail::BatchHeader);
+  const std::size_t bitsAt = valuesAt + detail::padded(count * sizeof(TYPE));
+  const std::size_t indexAt = bitsAt + (count + 63) / 64 * sizeof(std::uint64_t);
+  out.resize(indexAt, 0);
+
+  //Values and valid bits go straight into place; errors are gathered so the
+  //index can precede their payloads.
+  std::vector<std::pair<std::uint64_t, ErrorInfo>> errors;
+  std::size_t i = 0;
+  for(auto itr = first; itr != last; ++itr, ++i) {
+    if(itr->valid()) {
+      std::memcpy(&out[valuesAt + i * sizeof(TYPE)], &itr->get(), sizeof(TYPE));
+      std::uint64_t bits = detail::readRaw<std::uint64_t>(&out[bitsAt + i / 64 * 8]);
+      bits |= std::uint64_t(1) << (i % 64);
+      std::memcpy(&out[bitsAt + i / 64 * 8], &bits, sizeof(bits));
+    } else {
+      errors.emplace_back(i, detail::describeHeld(*itr, registry));
+    }
+  }
+
+  std::uint64_t offset = indexAt - start + errors.size() * sizeof(detail::IndexEntry);
+  for(const auto& error : errors) {
+    const detail::IndexEntry entry{error.first, offset};
+    detail::append(out, &entry, sizeof(entry));
+    offset += detail::errorPayloadSize(error.second);
+  }
+  for(const auto& error : errors) detail::appendErrorPayload(out, error.second);
+
+  const detail::BatchHeader header{
+    {'M', 'E', 'X', 'B'}, detail::kBatchVersion,
+    sizeof(TYPE), alignof(TYPE), count, errors.size(), out.size() - start
+  };
+  std::memcpy(&out[start], &header, sizeof(header));
+}
+
+template<typename TYPE>
+BatchView<TYPE>::BatchView(const char* data, std::size_t size) : data_(data) {
+  detail::checkWireable<TYPE>();
+  detail::checkAligned(data);
+  if(size < sizeof(detail::BatchHeader)) throw FormatError("truncated batch header");
+  const auto header = detail::readRaw<detail::BatchHeader>(data);
+  if(std::memcmp(header.magic, "MEXB", 4) != 0) throw FormatError("not a batch");
+  if(header.version != detail::kBatchVersion) {
+    throw FormatError("unsupported batch version or byte order");
+  }
+  if(header.valueSize != sizeof(TYPE) || header.valueAlign != alignof(TYPE)) {
+    throw FormatError("batch holds another type");
+  }
+  if(header.totalSize > size) throw FormatError("truncated batch");
+
+  count_ = header.count;
+  errorCount_ = header.errorCount;
+  byteSize_ = header.totalSize;
+  //Check the sections fit before computing their (possibly overflowing) ends.
+  if(count_ > byteSize_ / sizeof(TYPE) || errorCount_ > count_) {
+    throw FormatError("batch counts exceed its size");
+  }
+  const std::size_t valuesAt = sizeof(detail::BatchHeader);
+  const std::size_t bitsAt = valuesAt + detail::padded(count_ * sizeof(TYPE));
+  const std::size_t indexAt = bitsAt + (count_ + 63) / 64 * sizeof(std::uint64_t);
+  if(indexAt + errorCount_ * sizeof(detail::IndexEntry) > byteSize_) {
+    throw FormatError("batch counts exceed its size");
+  }
+  values_ = reinterpret_cast<const TYPE*>(data + valuesAt);
+  validBits_ = reinterpret_cast<const std::uint64_t*>(data + bitsAt);
+  index_ = data + indexAt;
+}
+
+template<typename TYPE>
+ErrorView BatchView<TYPE>::error(std::size_t i) const {
+  std::size_t low = 0;
+  std::size_t high = errorCount_;
+  while(low < high) {
+    const std::size_t mid = low + (high - low) / 2;
+    const auto entry = detail::readRaw<detail::IndexEntry>(
+      index_ + mid * sizeof(detail::IndexEntry));
+    if(entry.index < i) {
+      low = mid + 1;
+    } else if(entry.index > i) {
+      high = mid;
+    } else {
+      if(entry.offset > byteSize_) throw FormatError("error offset out of bounds");
+      return detail::readErrorPayload(data_ + entry.offset, byteSize_ - entry.offset);
+    }
+  }
+  throw FormatError("no error recorded for this element");
+}
+
+template<typename TYPE>
+Expected<TYPE> BatchView<TYPE>::at(std::size_t i, const ErrorRegistry& registry) const {
+  if(valid(i)) return Expected<TYPE>(values_[i]);
+  return Expected<TYPE>(error(i).rebuild(registry));
+}
+
+} //namespace wire
+} //namespace mex
@@ -0,0 +1,168 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+#include "Expected.h"
+#include "wire.h"
+
+/*
+ * mex::wire encode and decode throughput, in millions of results per second
+ * (best of three runs), with the encoded size per result:
+ *    * records of values, decoded with decode() as each RecordView is walked;
+ *      and the same again encoded with encodeInPlace() into fixed size slots.
+ *    * records of errors (std::out_of_range, which is registered), decoded
+ *      both into Expecteds holding the rebuilt exception and, for comparison,
+ *      only as far as the ErrorView, which neither allocates nor throws.
+ *    * batches of values, read straight out of BatchView::values(); and
+ *      batches with every tenth result an error, read with at(i).
+ *
+ * Usage: wireBench [results (default 1000000)]
+ */
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+
+using mex::Expected;
+
+namespace wire = mex::wire;
+
+struct Sample {
+  std::int64_t index;
+  double value;
+};
+
+volatile std::int64_t sink = 0; //Keeps the results alive.
+
+//Best of a few runs, in seconds.
+template<typename RUN>
+double bestOf(RUN run) {
+  double best = 1e300;
+  for(int i = 0; i < 3; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+//encode() fills the buffer and decode() reads it back; both are timed.
+template<typename ENCODE, typename DECODE>
+void report(const string& name, std::size_t count, vector<char>& buffer,
+            ENCODE encode, DECODE decode) {
+  const double encodeSeconds = bestOf(encode);
+  const double decodeSeconds = bestOf(decode);
+  cout << "  " << std::left << std::setw(26) << name << std::right << std::fixed
+       << std::setprecision(1) << std::setw(7) << double(buffer.size()) / count
+       << std::setprecision(2) << std::setw(11) << count / encodeSeconds / 1e6
+       << std::setw(11) << count / decodeSeconds / 1e6
+       << std::setw(12) << count / (encodeSeconds + decodeSeconds) / 1e6 << endl;
+}
+
+//Walks the records in buffer, handing each RecordView to read().
+template<typename READ>
+void forEachRecord(const vector<char>& buffer, READ read) {
+  for(std::size_t at = 0; at < buffer.size(); ) {
+    const wire::RecordView<Sample> record(buffer.data() + at, buffer.size() - at);
+    read(record);
+    at += record.byteSize();
+  }
+}
+
+int main(int argc, char** argv) {
+  const std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  if(count < 1) {
+    std::cerr << "usage: wireBench [results]" << endl;
+    return 1;
+  }
+  vector<Expected<Sample>> values, errors, mixed;
+  for(std::size_t i = 0; i < count; ++i) {
+    const std::int64_t index = i;
+    values.push_back(Sample{index, index * 0.25});
+    errors.push_back(std::out_of_range("sample " + std::to_string(i)));
+    mixed.push_back(i % 10 == 9 ? errors.back() : values.back());
+  }
+  vector<char> buffer;
+
+  cout << count << " results of " << sizeof(Sample) << " bytes" << endl;
+  cout << std::setw(35) << "bytes" << std::setw(11) << "encode" << std::setw(11)
+       << "decode" << std::setw(12) << "round trip" << "  (M results/s)" << endl;
+
+  auto encodeRecords = [&buffer](const vector<Expected<Sample>>& results) {
+    return [&buffer, &results]() {
+      buffer.clear();
+      for(const auto& r : results) wire::encode(r, buffer);
+    };
+  };
+
+  report("value records", count, buffer, encodeRecords(values), [&]() {
+    std::int64_t total = 0;
+    forEachRecord(buffer, [&](const wire::RecordView<Sample>& record) {
+      total += record.toExpected().get().index;
+    });
+    sink += total;
+  });
+
+  const std::size_t slot = wire::recordCapacity<Sample>(64);
+  report("value records, in place", count, buffer, [&]() {
+    buffer.resize(count * slot);
+    for(std::size_t i = 0; i < count; ++i) {
+      wire::encodeInPlace(values[i], buffer.data() + i * slot, slot);
+    }
+  }, [&]() {
+    std::int64_t total = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+      total += wire::decode<Sample>(buffer.data() + i * slot, slot).get().index;
+    }
+    sink += total;
+  });
+
+  report("error records", count, buffer, encodeRecords(errors), [&]() {
+    std::int64_t total = 0;
+    forEachRecord(buffer, [&](const wire::RecordView<Sample>& record) {
+      total += record.toExpected().hasException<std::out_of_range>();
+    });
+    sink += total;
+  });
+
+  report("error records, view only", count, buffer, encodeRecords(errors), [&]() {
+    std::int64_t total = 0;
+    forEachRecord(buffer, [&](const wire::RecordView<Sample>& record) {
+      total += record.error().messageLength;
+    });
+    sink += total;
+  });
+
+  report("batch of values", count, buffer, [&]() {
+    buffer.clear();
+    wire::encodeBatch(values.begin(), values.end(), buffer);
+  }, [&]() {
+    const wire::BatchView<Sample> batch(buffer.data(), buffer.size());
+    std::int64_t total = 0;
+    for(std::size_t i = 0; i < batch.size(); ++i) total += batch.values()[i].index;
+    sink += total;
+  });
+
+  report("batch, 10% errors, at(i)", count, buffer, [&]() {
+    buffer.clear();
+    wire::encodeBatch(mixed.begin(), mixed.end(), buffer);
+  }, [&]() {
+    const wire::BatchView<Sample> batch(buffer.data(), buffer.size());
+    std::int64_t total = 0;
+    for(std::size_t i = 0; i < batch.size(); ++i) {
+      const Expected<Sample> r = batch.at(i);
+      total += r.valid() ? r.get().index : 1;
+    }
+    sink += total;
+  });
+  return 0;
+}
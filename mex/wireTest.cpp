@@ -0,0 +1,253 @@
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+#include "Expected.h"
+#include "wire.h"
+#include "unittest.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+
+using mex::Expected;
+
+namespace wire = mex::wire;
+
+int main(int argc, char** argv) {
+  unittest::runUnitTests();
+  cout << "All tests completed successfully." << endl;
+  return 0;
+}
+
+struct Point {
+  double x;
+  double y;
+  std::int32_t id;
+};
+
+class ParseError : public std::runtime_error {
+public:
+  explicit ParseError(const string& what) : std::runtime_error(what) {}
+};
+
+class Unregistered : public std::runtime_error {
+public:
+  explicit Unregistered(const string& what) : std::runtime_error(what) {}
+};
+
+MEX_UNIT_TEST
+  vector<char> buffer;
+  wire::encode(Expected<Point>(Point{1.5, -2.0, 7}), buffer);
+  wire::encode(Expected<Point>(std::out_of_range("too far")), buffer);
+  wire::encode(Expected<int>(42), buffer);
+  assert(buffer.size() % 8 == 0);
+
+  //vector<char>'s storage comes from operator new, so it is suitably aligned.
+  const char* at = buffer.data();
+  std::size_t left = buffer.size();
+  wire::RecordView<Point> first(at, left);
+  assert(first.valid());
+  assert(first.value().x == 1.5 && first.value().id == 7);
+  assert(&first.value() == reinterpret_cast<const Point*>(at + 8)); //In place.
+  at += first.byteSize();
+  left -= first.byteSize();
+
+  wire::RecordView<Point> second(at, left);
+  assert(!second.valid());
+  assert(string(second.error().message) == "too far");
+  assert(second.toExpected().hasException<std::out_of_range>());
+  unittest::expect_exception<std::out_of_range>([&]() { second.value(); });
+  at += second.byteSize();
+  left -= second.byteSize();
+
+  assert(wire::decode<int>(at, left).get() == 42);
+  assert(wire::RecordView<int>(at, left).byteSize() == left);
+
+  //A record of one type cannot be read as another.
+  unittest::expect_exception<wire::FormatError>([&]() {
+    wire::RecordView<Point>(at, left);
+  });
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Standard exceptions come back as their own type with their message.
+  vector<Expected<int>> errors {
+    std::invalid_argument("bad"), std::length_error("long"),
+    std::underflow_error("small"), std::logic_error("logic"),
+    std::runtime_error("runtime")
+  };
+  for(const auto& error : errors) {
+    vector<char> buffer;
+    wire::encode(error, buffer);
+    const auto back = wire::decode<int>(buffer.data(), buffer.size());
+    try {
+      error.throwException();
+    } catch(const std::exception& original) {
+      try {
+        back.throwException();
+        assert(false);
+      } catch(const std::exception& rebuilt) {
+        assert(typeid(rebuilt) == typeid(original));
+        assert(string(rebuilt.what()) == original.what());
+      }
+    }
+  }
+
+  //system_error keeps its code, and its message does not grow on each hop.
+  Expected<int> failed = std::system_error(ENOENT, std::generic_category(), "open");
+  for(int hop = 0; hop < 3; ++hop) {
+    vector<char> buffer;
+    wire::encode(failed, buffer);
+    failed = wire::decode<int>(buffer.data(), buffer.size());
+  }
+  try {
+    failed.throwException();
+    assert(false);
+  } catch(const std::system_error& e) {
+    assert(e.code().value() == ENOENT);
+    assert(string(e.what()) == std::system_error(ENOENT, std::generic_category(), "open").what());
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Application exceptions need registering; unregistered ones arrive as
+  //RemoteErrors that keep their tag and code through further hops.
+  wire::ErrorRegistry registry;
+  registry.add<ParseError>(wire::kFirstUserTag);
+  unittest::expect_exception<std::invalid_argument>([&]() {
+    registry.add<Unregistered>(wire::kFirstUserTag);
+  });
+  unittest::expect_exception<std::invalid_argument>([&]() {
+    registry.add<ParseError>(wire::kFirstUserTag + 1);
+  });
+
+  vector<char> buffer;
+  wire::encode(Expected<int>(ParseError("line 3")), buffer, registry);
+  assert(wire::decode<int>(buffer.data(), buffer.size(), registry)
+         .hasException<ParseError>());
+
+  //The global registry has never heard of ParseError.
+  const auto remote = wire::decode<int>(buffer.data(), buffer.size());
+  try {
+    remote.throwException();
+    assert(false);
+  } catch(const wire::RemoteError& e) {
+    assert(e.tag() == wire::kFirstUserTag);
+    assert(string(e.what()) == "line 3");
+  }
+  vector<char> forwarded;
+  wire::encode(remote, forwarded);
+  assert(wire::decode<int>(forwarded.data(), forwarded.size(), registry)
+         .hasException<ParseError>());
+
+  buffer.clear();
+  wire::encode(Expected<int>(Unregistered("who")), buffer, registry);
+  wire::RecordView<int> view(buffer.data(), buffer.size());
+  assert(view.error().tag == wire::kUnregisteredTag);
+  assert(view.toExpected(registry).hasException<wire::RemoteError>());
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  vector<Expected<Point>> results;
+  for(int i = 0; i < 150; ++i) {
+    if(i % 7 == 3) results.emplace_back(std::invalid_argument("bad " + std::to_string(i)));
+    else results.emplace_back(Point{i * 0.5, -i * 1.0, i});
+  }
+
+  vector<char> buffer(5, 'x'); //Batches start at an aligned offset.
+  wire::encodeBatch(results.begin(), results.end(), buffer);
+  const char* data = buffer.data() + 8;
+  wire::BatchView<Point> batch(data, buffer.size() - 8);
+  assert(batch.size() == results.size());
+  assert(batch.byteSize() == buffer.size() - 8);
+  assert(batch.errorCount() == 21);
+
+  for(std::size_t i = 0; i < batch.size(); ++i) {
+    assert(batch.valid(i) == results[i].valid());
+    if(batch.valid(i)) {
+      assert(batch.value(i).id == results[i].get().id);
+      assert(batch.values()[i].y == results[i].get().y);
+      assert(batch.at(i).get().x == results[i].get().x);
+    } else {
+      assert(string(batch.error(i).message) == "bad " + std::to_string(i));
+      assert(batch.values()[i].id == 0);
+      assert(batch.at(i).hasException<std::invalid_argument>());
+    }
+  }
+  unittest::expect_exception<std::out_of_range>([&]() { batch.valid(batch.size()); });
+  unittest::expect_exception<std::out_of_range>([&]() { batch.at(batch.size()); });
+
+  vector<Expected<int>> none;
+  vector<char> empty;
+  wire::encodeBatch(none.begin(), none.end(), empty);
+  assert(wire::BatchView<int>(empty.data(), empty.size()).size() == 0);
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //Malformed buffers are rejected rather than read out of bounds.
+  vector<Expected<std::int64_t>> results { std::int64_t(1), std::runtime_error("x") };
+  vector<char> buffer;
+  wire::encodeBatch(results.begin(), results.end(), buffer);
+
+  for(std::size_t size = 0; size < buffer.size(); ++size) {
+    unittest::expect_exception<wire::FormatError>([&]() {
+      wire::BatchView<std::int64_t>(buffer.data(), size);
+    });
+  }
+  unittest::expect_exception<wire::FormatError>([&]() {
+    wire::BatchView<std::int32_t>(buffer.data(), buffer.size());
+  });
+  unittest::expect_exception<wire::FormatError>([&]() {
+    wire::BatchView<std::int64_t>(buffer.data() + 1, buffer.size() - 1);
+  });
+
+  vector<char> corrupt = buffer;
+  corrupt[0] = 'X';
+  unittest::expect_exception<wire::FormatError>([&]() {
+    wire::BatchView<std::int64_t>(corrupt.data(), corrupt.size());
+  });
+
+  //Claim a message longer than the batch.
+  corrupt = buffer;
+  //The last error payload is 24 bytes, with its message length 8 bytes in.
+  const std::uint32_t hugeLength = 1000;
+  std::memcpy(&corrupt[corrupt.size() - 16], &hugeLength, sizeof(hugeLength));
+  wire::BatchView<std::int64_t> lying(corrupt.data(), corrupt.size());
+  assert(lying.value(0) == 1);
+  unittest::expect_exception<wire::FormatError>([&]() { lying.error(1); });
+
+  vector<char> record;
+  wire::encode(Expected<int>(std::runtime_error("truncated")), record);
+  for(std::size_t size = 0; size < record.size(); ++size) {
+    unittest::expect_exception<wire::FormatError>([&]() {
+      wire::RecordView<int>(record.data(), size);
+    });
+  }
+MEX_END_UNIT_TEST
+
+MEX_UNIT_TEST
+  //In place encoding truncates messages to whole words of the capacity.
+  const std::size_t capacity = wire::recordCapacity<int>(0) + 5;
+  vector<char> slot(capacity);
+  const Expected<int> failed = std::runtime_error(string(100, 'x'));
+  const std::size_t used = wire::encodeInPlace(failed, slot.data(), capacity);
+  assert(used <= capacity);
+  wire::RecordView<int> view(slot.data(), used);
+  assert(!view.valid() && view.error().messageLength < 100);
+  assert(string(view.error().message) == string(view.error().messageLength, 'x'));
+
+  assert(wire::encodeInPlace(Expected<int>(3), slot.data(), capacity) <= capacity);
+  assert(wire::RecordView<int>(slot.data(), capacity).value() == 3);
+  unittest::expect_exception<std::invalid_argument>([&]() {
+    wire::encodeInPlace(failed, slot.data(), wire::recordCapacity<int>(0) - 1);
+  });
+MEX_END_UNIT_TEST